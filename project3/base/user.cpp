@@ -3,6 +3,7 @@
 
 #include "Joystick.h"
 #include "Packet.h"
+#include "schedule.h"
 
 extern "C" {
     #include "kernel.h"
@@ -54,20 +55,47 @@ void updatePacket(void) {
     })
 }
 
+/**
+ * PORTB 0 pulses as a packet is queued, the remote's PORTB 0 rises once it is
+ * handling it, the time between them is the joystick to remote latency.
+ */
 void TXData(void) {
     TASK({
         if (UART_Writable(data_channel)) {
-            UART_send_raw_bytes(data_channel, PACKET_SIZE, packet.data);
+            BIT_SET(PORTB, 0);
+            if (PACKET_COBS) {
+                uint8_t frame[PACKET_FRAME_SIZE];
+                UART_send_raw_bytes(data_channel, packet.frame(frame), frame);
+            } else {
+                UART_send_raw_bytes(data_channel, PACKET_SIZE, packet.bytes());
+            }
+            BIT_CLR(PORTB, 0);
         }
     })
 }
 
+constexpr PeriodicTask periodic_tasks[] = {
+    { updatePacket, 0, UPDATE_PACKET_PERIOD, UPDATE_PACKET_WCET, UPDATE_PACKET_DELAY },
+    { TXData,       0, SEND_PACKET_PERIOD,   SEND_PACKET_WCET,   SEND_PACKET_DELAY   }
+};
+
+static_assert(schedule::valid(periodic_tasks), "Base station has an invalid periodic task in timings.h");
+
+// conflict_free() does not hold for these rates. TXData's 5 TICK window from TICK 5
+// covers updatePacket's releases on TICKs 5, 7 and 9. Under POLICY_RELEASE it runs only
+// while TXData finishes before updatePacket's next release, which nothing checks at
+// compile time. There is no schedule table for the set, a POLICY=TABLE build stops here.
+static_assert(PERIODIC_POLICY != POLICY_TABLE, "Base station periodic tasks overlap, no schedule table for timings.h");
+
 void create(void) {
     UART_Init(data_channel, 38400);
 
+    // Packet sent pin
+    BIT_SET(DDRB, 0);
+    BIT_CLR(PORTB, 0);
+
     // Create tasks
-    Task_Create_Period(updatePacket, 0, UPDATE_PACKET_PERIOD, UPDATE_PACKET_WCET, UPDATE_PACKET_DELAY);
-    Task_Create_Period(TXData,       0, SEND_PACKET_PERIOD,   SEND_PACKET_WCET,   SEND_PACKET_DELAY);
+    schedule::create(periodic_tasks);
 
     return;
 }
@@ -9,13 +9,13 @@ Arm::Arm():
     X({
         .pos     = 90,
         .speed   = 0,
-        .lastRun = Now(),
+        .lastRun = Now32(),
         .servo   = Motor()
     }),
     Y({
         .pos     = 0,
         .speed   = 0,
-        .lastRun = Now(),
+        .lastRun = Now32(),
         .servo   = Motor()
     })
 { }
@@ -48,7 +48,7 @@ int8_t Arm::filterSpeed(int16_t value) {
 }
 
 void Arm::tick() {
-    uint32_t now = Now();
+    uint32_t now = Now32();
 
     uint32_t deltaX = now - this->X.lastRun;
     uint32_t deltaY = now - this->Y.lastRun;
@@ -0,0 +1,141 @@
+#include "Frame.h"
+
+
+/**
+ * Starts waiting for frames with an "expected" byte payload, no bigger than FRAME_MAX
+ */
+void Frame_Init(FRAME_PARSER* parser, uint8_t expected) {
+    if (expected > FRAME_MAX) {
+        expected = FRAME_MAX;
+    }
+
+    parser->expected = expected;
+    parser->length = 0;
+    parser->left = 0;
+    parser->code = 0xFF;
+    parser->skip = FALSE;
+    parser->good = 0;
+    parser->framing_errors = 0;
+    parser->checksum_errors = 0;
+}
+
+static FRAME_RESULT Frame_End(FRAME_PARSER* parser) {
+    FRAME_RESULT result;
+    uint8_t len = parser->length;
+    uint16_t checksum;
+
+    if (parser->skip || parser->left != 0 || len != parser->expected || len < 2) {
+        // Too long, cut short, or a bad block
+        result = FRAME_BAD_FRAMING;
+        parser->framing_errors += 1;
+    } else {
+        checksum = Frame_Checksum(parser->payload, len - 2);
+
+        if (parser->payload[len - 2] == HIGH_BYTE(checksum) &&
+            parser->payload[len - 1] == LOW_BYTE(checksum)) {
+            result = FRAME_GOOD;
+            parser->good += 1;
+        } else {
+            result = FRAME_BAD_CHECKSUM;
+            parser->checksum_errors += 1;
+        }
+    }
+
+    // The next frame starts right after the delimiter
+    parser->length = 0;
+    parser->left = 0;
+    parser->code = 0xFF;
+    parser->skip = FALSE;
+
+    return result;
+}
+
+static void Frame_Append(FRAME_PARSER* parser, uint8_t byte) {
+    if (parser->length == parser->expected) {
+        parser->skip = TRUE;
+    } else {
+        parser->payload[parser->length] = byte;
+        parser->length += 1;
+    }
+}
+
+/**
+ * Feeds the next byte of the stream, the result says whether a frame ended on it
+ */
+FRAME_RESULT Frame_Feed(FRAME_PARSER* parser, uint8_t byte) {
+    if (byte == FRAME_DELIM) {
+        // Ends the frame whatever state it is in, so sync is never lost for longer
+        return Frame_End(parser);
+    }
+
+    if (parser->skip) {
+        return FRAME_PENDING;
+    }
+
+    if (parser->left == 0) {
+        // A code byte, each block but the first follows a 0x00, unless the one
+        // before it was full
+        if (parser->code != 0xFF) {
+            Frame_Append(parser, 0x00);
+        }
+        parser->code = byte;
+        parser->left = byte - 1;
+    } else {
+        Frame_Append(parser, byte);
+        parser->left -= 1;
+    }
+
+    return FRAME_PENDING;
+}
+
+uint8_t Frame_Encode(const uint8_t* payload, uint8_t len, uint8_t* out) {
+    uint8_t code_at = 0;
+    uint8_t code = 1;
+    uint8_t n = 1;
+    uint8_t i;
+
+    for (i = 0; i < len; i += 1) {
+        if (payload[i] == 0x00) {
+            // The 0x00 is replaced by the distance to it
+            out[code_at] = code;
+            code_at = n;
+            n += 1;
+            code = 1;
+        } else {
+            out[n] = payload[i];
+            n += 1;
+            code += 1;
+        }
+    }
+
+    out[code_at] = code;
+    out[n] = FRAME_DELIM;
+
+    return n + 1;
+}
+
+uint16_t Frame_Checksum(const uint8_t* data, uint8_t len) {
+    // Fletcher's checksum
+    // https://en.wikipedia.org/wiki/Fletcher%27s_checksum
+    // The sums are reduced as they go by adding the carry back in, 256 being 1
+    // mod 255, so they stay 8 bit and no division is needed. 255 stands for 0
+    // until the end.
+    uint16_t c0 = 0, c1 = 0;
+    uint8_t i;
+
+    for (i = 0; i < len; i += 1) {
+        c0 += data[i];
+        c0 = (c0 & 0xFF) + (c0 >> 8);
+        c1 += c0;
+        c1 = (c1 & 0xFF) + (c1 >> 8);
+    }
+
+    if (c0 == 255) {
+        c0 = 0;
+    }
+    if (c1 == 255) {
+        c1 = 0;
+    }
+
+    return (c1 << 8) | c0;
+}
@@ -0,0 +1,68 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stdint.h>
+#include "common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * COBS framing for byte streams
+ * https://en.wikipedia.org/wiki/Consistent_Overhead_Byte_Stuffing
+ *
+ * A frame is a payload whose last 2 bytes are the Fletcher-16 checksum of the
+ * rest, COBS encoded so it holds no 0x00, and ended by a FRAME_DELIM. A receiver
+ * that joins mid stream, or loses bytes, is back in sync at the next FRAME_DELIM.
+ */
+#define FRAME_DELIM 0x00
+#define FRAME_MAX   32                      /* Largest payload, at most 253 for 1 overhead byte */
+#define FRAME_SIZE(len) ((len) + 2)         /* Encoded size, overhead byte and FRAME_DELIM */
+
+#ifndef PACKET_COBS
+#define PACKET_COBS 1                       /* Send Packets COBS framed, instead of found by PACKET_MAGIC */
+#endif
+
+typedef enum {
+    FRAME_PENDING,                          /* No frame ended on this byte */
+    FRAME_GOOD,                             /* A frame ended and its payload is valid */
+    FRAME_BAD_FRAMING,                      /* A frame ended with the wrong length or bad encoding */
+    FRAME_BAD_CHECKSUM                      /* A frame ended with the right length, but its checksum is wrong */
+} FRAME_RESULT;
+
+/**
+ * Decodes a stream one byte at a time. It only touches its own state, so it may be
+ * fed from an interrupt handler or a task, but only one of them.
+ */
+typedef struct {
+    uint8_t  payload[FRAME_MAX];            /* The decoded payload, valid after FRAME_GOOD */
+    uint8_t  expected;                      /* Payload length of a valid frame */
+    uint8_t  length;                        /* Bytes decoded so far */
+    uint8_t  left;                          /* Bytes left in the current COBS block */
+    uint8_t  code;                          /* Code byte of the current COBS block */
+    BOOL     skip;                          /* The frame is already bad, wait for FRAME_DELIM */
+    uint16_t good;                          /* Frames with a valid payload */
+    uint16_t framing_errors;                /* Frames with the wrong length or bad encoding */
+    uint16_t checksum_errors;               /* Frames with a bad checksum */
+} FRAME_PARSER;
+
+void         Frame_Init(FRAME_PARSER* parser, uint8_t expected);
+FRAME_RESULT Frame_Feed(FRAME_PARSER* parser, uint8_t byte);
+
+/**
+ * Encodes "len" bytes of "payload" into "out", which must hold FRAME_SIZE(len)
+ * bytes, including the closing FRAME_DELIM. Returns the encoded size.
+ */
+uint8_t  Frame_Encode(const uint8_t* payload, uint8_t len, uint8_t* out);
+
+/**
+ * Fletcher-16 of "len" bytes, the first sum in the low byte
+ */
+uint16_t Frame_Checksum(const uint8_t* data, uint8_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
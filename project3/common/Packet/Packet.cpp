@@ -1,6 +1,16 @@
 
 #include "Packet.h"
 
+static_assert(PACKET_SIZE <= FRAME_MAX, "A Packet doesn't fit in a frame, raise FRAME_MAX");
+
+/**
+ * Construct an empty packet, all fields are 0
+ */
+Packet::Packet()
+{
+    this->stale = false;
+    ZeroMemory(this->data, PACKET_SIZE);
+}
 
 /**
  * Construct a packet from a buffer
@@ -8,6 +18,8 @@
  */
 Packet::Packet(uint8_t* buffer)
 {
+    this->stale = false;
+
     if (TO16BIT(buffer[0], buffer[1]) == PACKET_MAGIC) {
         memcpy(this->data, buffer, PACKET_SIZE);
         uint16_t checksum = TO16BIT(this->data[12], this->data[13]);
@@ -49,32 +61,13 @@ Packet::Packet(uint16_t joy1X, uint16_t joy1Y, uint8_t joy1SW, uint16_t joy2X, u
 }
 
 void Packet::updateChecksum() {
-    uint8_t* data = this-> data;
-    uint16_t len  = PACKET_SIZE - 2;
+    uint16_t checksum = Frame_Checksum(this->data, PACKET_SIZE - 2);
 
-    // Fletcher's checksum
-    // https://en.wikipedia.org/wiki/Fletcher%27s_checksum
-
-    uint32_t c0, c1;
-    unsigned int i;
-
-    for (c0 = c1 = 0; len >= 5802; len -= 5802) {
-            for (i = 0; i < 5802; ++i) {
-                    c0 = c0 + *data++;
-                    c1 = c1 + c0;
-            }
-            c0 = c0 % 255;
-            c1 = c1 % 255;
-    }
-
-    for (i = 0; i < len; ++i) {
-            c0 = c0 + *data++;
-            c1 = c1 + c0;
-    }
-    c0 = c0 % 255;
-    c1 = c1 % 255;
+    this->data[12] = HIGH_BYTE(checksum);
+    this->data[13] = LOW_BYTE(checksum);
+    this->stale = false;
+}
 
-    // uint16_t checksum = (c1 << 8) | c0;
-    this->data[12] = c1; // HIGH_BYTE(checksum);
-    this->data[13] = c0; // LOW_BYTE(checksum);
+uint8_t Packet::frame(uint8_t* out) {
+    return Frame_Encode(bytes(), PACKET_SIZE, out);
 }
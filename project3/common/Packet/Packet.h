@@ -4,6 +4,7 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include "common.h"
+#include "Frame.h"
 
 #define PACKET_MAGIC 0xFEED
 #define TO16BIT(h, l) ((uint16_t)((h & 0xFF) << 8 | (l & 0xFF)))
@@ -17,12 +18,14 @@
 #define PACKET_CHECKSUM_SIZE 1*sizeof(uint16_t)
 
 #define PACKET_SIZE PACKET_MAGIC_SIZE + PACKET_XY_SIZE + PACKET_SW_SIZE + PACKET_CHECKSUM_SIZE
+#define PACKET_FRAME_SIZE FRAME_SIZE(PACKET_SIZE)
 
 
 class Packet {
   public:
     uint8_t data[PACKET_SIZE];
 
+    Packet();
     Packet(uint8_t* buffer);
     Packet(uint16_t joy1X, uint16_t joy1Y, uint8_t joy1SW, uint16_t joy2X, uint16_t joy2Y, uint8_t joy2SW);
 
@@ -34,17 +37,26 @@ class Packet {
     inline uint16_t    joy2Y() { return TO16BIT(this->data[8], this->data[9]); }
     inline uint8_t    joy1SW() { return this->data[10]; }
     inline uint8_t    joy2SW() { return this->data[11]; }
-    inline uint16_t checksum() { return TO16BIT(this->data[12], this->data[13]); }
+    inline uint16_t checksum() { bytes(); return TO16BIT(this->data[12], this->data[13]); }
 
-    /* Inline Packet field setters */
-    inline void joy1X(uint16_t value) { PACKET_VALUE_ASSIGN(2, value); updateChecksum(); }
-    inline void joy1Y(uint16_t value) { PACKET_VALUE_ASSIGN(4, value); updateChecksum(); }
-    inline void joy2X(uint16_t value) { PACKET_VALUE_ASSIGN(6, value); updateChecksum(); }
-    inline void joy2Y(uint16_t value) { PACKET_VALUE_ASSIGN(8, value); updateChecksum(); }
-    inline void joy1SW(uint8_t value) { this->data[10] = value;        updateChecksum(); }
-    inline void joy2SW(uint8_t value) { this->data[11] = value;        updateChecksum(); }
+    /* Inline Packet field setters, the checksum is brought up to date when it is next read */
+    inline void joy1X(uint16_t value) { PACKET_VALUE_ASSIGN(2, value); this->stale = true; }
+    inline void joy1Y(uint16_t value) { PACKET_VALUE_ASSIGN(4, value); this->stale = true; }
+    inline void joy2X(uint16_t value) { PACKET_VALUE_ASSIGN(6, value); this->stale = true; }
+    inline void joy2Y(uint16_t value) { PACKET_VALUE_ASSIGN(8, value); this->stale = true; }
+    inline void joy1SW(uint8_t value) { this->data[10] = value;        this->stale = true; }
+    inline void joy2SW(uint8_t value) { this->data[11] = value;        this->stale = true; }
 
     void updateChecksum();
+
+    /* The packet as sent, with its checksum up to date */
+    inline uint8_t* bytes() { if (this->stale) updateChecksum(); return this->data; }
+
+    /* COBS encodes the packet into "out", which holds PACKET_FRAME_SIZE bytes */
+    uint8_t frame(uint8_t* out);
+
+  private:
+    bool stale;   /* A field changed since the checksum was computed */
 };
 
 #endif
@@ -3,10 +3,16 @@
 
 extern "C" {
     #include "uart.h"
-    #include "util/delay.h"
+    #include "../os/os.h"
     #include "../os/common.h"
 };
 
+// Waits at least `ms` milliseconds without holding the CPU, so the Roomba
+// must only be used from SYSTEM or RR tasks
+static void sleep_ms(uint16_t ms) {
+    Task_Sleep((ms + MSECPERTICK - 1) / MSECPERTICK + 1);
+}
+
 //serial_connector determines which UART the Roomba is connected to (0, 1, etc)
 //brc_pin determines where the baud rate change pin is connected.
 Roomba::Roomba(uint8_t serial_connector, uint8_t brc_pin)
@@ -21,19 +27,19 @@ Roomba::Roomba(uint8_t serial_connector, uint8_t brc_pin)
 bool Roomba::init() {
 
     BIT_SET(PORTA, baud_change_pin);
-    _delay_ms(2000);
+    sleep_ms(2000);
     // Set baud to 19200 by togling the brc pin low 3 times.
     for (uint8_t i = 6; i > 0; i -= 1) {
-        _delay_ms(300);
+        sleep_ms(300);
         BIT_FLIP(PORTA, baud_change_pin);
     }
 
     start_serial(19200);
-    _delay_ms(500);
+    sleep_ms(500);
 
     // Enable serial open interface and wait
     issue_cmd(OI_COMMAND::START_SCI);
-    _delay_ms(200);
+    sleep_ms(200);
 
     // Switch to faster baud
     issue_cmd(OI_COMMAND::BAUD);
@@ -42,7 +48,7 @@ bool Roomba::init() {
 
     // >> Roomba Docs: You must wait 100 ms before
     //    sending commands at the new baud rate
-    _delay_ms(100);
+    sleep_ms(100);
 
     // If baud is correct we should be in safe mode
     uint16_t mode = 0;
@@ -119,7 +125,7 @@ bool Roomba::check_sensor(OI_SENSOR_ARGS sensor, uint8_t nbytes, uint16_t *data)
     issue_cmd(OI_COMMAND::SENSORS);
     issue_cmd(sensor);
 
-    _delay_ms(50);
+    sleep_ms(50);
 
     success = try_read(&databyte_high);
 
@@ -216,7 +222,7 @@ void Roomba::set_mode(OI_MODE_TYPE mode) {
             LOG("Unknown command in Roomba::set_mode\n");
             break;
     }
-    _delay_ms(20);
+    sleep_ms(20);
 }
 
 void Roomba::power_off() {
@@ -1,5 +1,7 @@
 #include <stdint.h>
 #include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include <avr/pgmspace.h>
 #include <util/delay.h>
 #include "common.h"
 #include "process.h"
@@ -16,6 +18,12 @@
 
 #define VALID_ID(id) (id >= 0 && id < MAXTHREAD)
 
+#define MAX_SKIP      (uint16_t)(0x10000UL / TICK_COUNTS) /* Most TICKs OCR4A can span */
+#define RESYNC_MARGIN 2    /* TIMER4 counts, so OCR4A is never set behind TCNT4 */
+
+/* Periodic jobs that overlap preempt each other instead of being a timing violation */
+#define PREEMPTIVE_PERIODIC (PERIODIC_POLICY == POLICY_RM || PERIODIC_POLICY == POLICY_EDF)
+
 /* Predeclare abort handler so anyone can jump to it */
 void Kernel_Request_Abort();
 #define DIRECT_ABORT(CODE) { \
@@ -42,10 +50,65 @@ volatile static KERNEL_REQUEST_PARAMS* request_info;
 static PD Process[MAXTHREAD];
 static PD IdleProcess;
 
+/**
+ * Every task's stack, including the idle task's, is carved from this arena,
+ * so a task only pins as much memory as it asks for. Stacks are handed out
+ * from the bottom up. A terminated task's stack goes on the free list, to be
+ * reused by the next task it fits.
+ */
+typedef struct stack_block_type {
+    struct stack_block_type* next;
+    uint16_t size;
+} STACK_BLOCK;
+
+/**
+ * Stacks are filled with STACK_PATTERN when a task is created, so the lowest
+ * byte that no longer holds it marks the most the stack has ever been used.
+ * The bottom STACK_GUARD bytes are never used by a task that fits in its
+ * stack, they are checked each time the task enters the kernel.
+ */
+#define STACK_PATTERN 0xA5
+#define STACK_GUARD   4
+
+static uint8_t StackArena[STACK_ARENA];
+static uint16_t stack_top;          /* Bytes of StackArena handed out from the bottom */
+static STACK_BLOCK* free_stacks;
+
 task_queue_t system_tasks;
-task_queue_t periodic_tasks;
+task_heap_t  periodic_tasks;
 task_queue_t rr_tasks;
 
+/**
+ * With POLICY_RM or POLICY_EDF, periodic_tasks only holds the tasks waiting for
+ * their next release. Once released, a job moves here until it calls Task_Next(),
+ * ordered by period or by deadline, and the job at the top runs.
+ */
+task_heap_t  periodic_jobs;
+
+/**
+ * Bit i is set while the queue for PRIORITY_LEVEL i holds at least one task.
+ * The SYSTEM and RR queues only ever hold READY (or RUNNING) tasks. A task that
+ * blocks is unlinked from its queue, and is appended again when it is made ready,
+ * so choosing the next task never has to walk past blocked tasks.
+ */
+static uint8_t ready_levels;
+
+/**
+ * With PERIODIC_POLICY == POLICY_TABLE the periodic tasks aren't queued. A table,
+ * generated offline and kept in flash, names the periodic task that owns each TICK
+ * of the hyperperiod, and Dispatch() just reads the slot for the current TICK.
+ * Slot i is for the tasks created i TICKs after the table was installed, modulo
+ * the table length. schedule_tasks maps the slot's task index to its PD.
+ */
+static const uint8_t* schedule_table;
+static TICK schedule_length;
+static TICK schedule_slot;
+static PD* schedule_tasks[SLOT_TASK + 1];
+static uint8_t schedule_count;
+
+/** The periodic task whose job started and hasn't called Task_Next() yet */
+static PD* schedule_job;
+
 /**
  * This array represents an outgoing mailbox.
  * If Process[i] is in the SEND_BLOCK state then Messages[i] will be the message
@@ -54,12 +117,32 @@ task_queue_t rr_tasks;
 static MSG Messages[MAXTHREAD];
 
 /**
- * This message queue stores the order of messages that a process is trying to send.
- * If a process is trying to send a message, the message will be in this queue.
- * This queue is needed in addition to the Messages array so that the order of outgoing messages
- * is first come first serve. When a process receives a message, it will receive the first message sent to it.
+ * Event groups and counting semaphores. A task that waits on one is unlinked
+ * from its ready queue and linked into the object's `waiting` queue instead,
+ * so it costs Dispatch() nothing until Event_Set() or Sem_Signal() wakes it.
+ * Handle i refers to index i - 1, so 0 is never a valid handle.
  */
-static msg_queue_t msg_queue;
+typedef struct {
+    BOOL         used;
+    uint8_t      flags;
+    task_queue_t waiting;  /* EVENT_BLOCK tasks, their req_params say what they wait for */
+} EVENT_GROUP;
+
+typedef struct {
+    BOOL         used;
+    uint16_t     count;
+    task_queue_t waiting;  /* SEM_BLOCK tasks */
+} SEMAPHORE_CB;
+
+/**
+ * A delta queue of the tasks that sleep, or wait with a timeout, in the order they
+ * wake. Each task's sleep_delta counts from the task in front of it, and the first
+ * one's from now, so the timer only has to count down the first task.
+ */
+static PD* sleep_queue;
+
+static EVENT_GROUP Events[MAXEVENT];
+static SEMAPHORE_CB Semaphores[MAXSEM];
 
 /**
  * Since this is a "full-served" model, the kernel is executing using its own
@@ -78,6 +161,9 @@ volatile uint8_t* KernelSp;
  */
 volatile uint8_t* CurrentSp;
 
+/** How the context at CurrentSp was saved, FRAME_FULL or FRAME_LEAN */
+volatile uint8_t CurrentFrame;
+
 /** index to next task to run */
 volatile static uint16_t NextP;
 
@@ -90,8 +176,20 @@ volatile static uint16_t Tasks;
 /** number of ticks elapsed since boot */
 volatile static TICK sys_clock;
 
-/** state of system clock overflow */
-volatile static OVERFLOW_STATE clock_state;
+/** the high word of the 32 bit tick count, see Kernel_Read_Now32() */
+volatile static TICK sys_clock_hi;
+
+/** number of ticks the pending TIMER4 compare match accounts for */
+volatile static TICK clock_skip;
+
+/** number of ticks of the current TIMER4 period already added to sys_clock, by a resync */
+volatile static TICK clock_resynced;
+
+/** TCNT4 when the kernel last switched to or from a task, with CPU_ACCOUNTING */
+static uint16_t cpu_stamp;
+
+/** TIMER4 counts spent in the kernel */
+static uint32_t kernel_counts;
 
 /**
  * This internal kernel function is the context switching mechanism.
@@ -123,6 +221,12 @@ extern void Exit_Kernel();
  */
 extern void Enter_Kernel();
 
+/**
+ * Enter_Kernel() for the tasks' own requests. They are function calls, so only
+ * the registers a C function must preserve are saved. (See file "cswitch.S".)
+ */
+extern void Enter_Kernel_Lean();
+
 /* User level 'main' function */
 extern void create(void);
 
@@ -148,11 +252,484 @@ ISR(TIMER4_COMPA_vect) {
     }
 }
 
+/**
+ * Returns the queue that manages SYSTEM or RR tasks with the same priority as `p`
+ */
+static task_queue_t* Ready_Queue(PD* p) {
+    switch (p->priority) {
+        case SYSTEM:
+            return &system_tasks;
+        case RR:
+            return &rr_tasks;
+        default:
+            DIRECT_ABORT(INVALID_PRIORITY);
+            return NULL;
+    }
+}
+
+/**
+ * Marks `p` as READY and adds it to the back of its queue.
+ * Periodic tasks are added to the release heap, ordered by `p->release`, instead.
+ */
+static void Ready_Enqueue(PD* p) {
+    p->state = READY;
+
+    if (p->priority == PERIODIC && PERIODIC_POLICY == POLICY_TABLE) {
+        // The schedule table decides when periodic tasks run
+        return;
+    } else if (p->priority == PERIODIC && PREEMPTIVE_PERIODIC && (int16_t)(sys_clock - p->tons) >= 0) {
+        // Its job is released, it competes with the other released jobs
+        heap_push(&periodic_jobs, p);
+    } else if (p->priority == PERIODIC) {
+        heap_push(&periodic_tasks, p);
+    } else {
+        enqueue(Ready_Queue(p), p);
+    }
+
+    BIT_SET(ready_levels, p->priority);
+}
+
+/**
+ * Returns the heap that holds the periodic task `p`
+ */
+static task_heap_t* Periodic_Heap(PD* p) {
+    if (PREEMPTIVE_PERIODIC && p->heap_index < periodic_jobs.length &&
+        periodic_jobs.tasks[p->heap_index] == p) {
+        return &periodic_jobs;
+    }
+
+    return &periodic_tasks;
+}
+
+/**
+ * Removes the running task `p` from its queue, or from the release heap.
+ * We use the invariant that the running task is at the front of it's queue.
+ */
+static void Ready_Remove(PD* p) {
+    uint8_t remaining;
+
+    if (p->priority == PERIODIC && PERIODIC_POLICY == POLICY_TABLE) {
+        return;
+    } else if (p->priority == PERIODIC) {
+        heap_remove(Periodic_Heap(p), p);
+        remaining = periodic_tasks.length + periodic_jobs.length;
+    } else {
+        task_queue_t* queue = Ready_Queue(p);
+
+        if (deque(queue) != p) {
+            DIRECT_ABORT(WRONG_TASK_ORDER);
+            return;
+        }
+
+        remaining = queue->length;
+    }
+
+    if (remaining == 0) {
+        BIT_CLR(ready_levels, p->priority);
+    }
+}
+
+/**
+ * Moves the SYSTEM or RR task `p` to the queue for `level`.
+ * The running task stays at the front of its queue, any other ready task
+ * goes to the back.
+ */
+static void Set_Priority(PD* p, PRIORITY_LEVEL level) {
+    if (p->state != READY && p->state != RUNNING) {
+        // Not queued, it is queued at `level` once it's ready
+        p->priority = level;
+        return;
+    }
+
+    task_queue_t* queue = Ready_Queue(p);
+    queue_remove(queue, p);
+
+    if (queue->length == 0) {
+        BIT_CLR(ready_levels, p->priority);
+    }
+
+    p->priority = level;
+
+    if (p == Cp) {
+        enqueue_front(Ready_Queue(p), p);
+    } else {
+        enqueue(Ready_Queue(p), p);
+    }
+
+    BIT_SET(ready_levels, p->priority);
+}
+
+/**
+ * Priority inheritance, a server runs at the highest priority among its own
+ * and the tasks that are SEND_BLOCK or REPLY_BLOCK on it. So a SYSTEM task waiting
+ * on a RR server doesn't also wait behind every other RR task.
+ * Recomputes the priority of `server`, and of the server it waits on in turn.
+ */
+static void Inherit_Priority(PD* server) {
+    uint8_t hops;
+    uint8_t i;
+
+    // Periodic tasks don't pass messages, so only SYSTEM and RR levels are inherited
+    for (hops = 0; server != NULL && server->base_priority != PERIODIC && hops < MAXTHREAD; hops += 1) {
+        PRIORITY_LEVEL level = server->base_priority;
+
+        for (i = 0; i < MAXTHREAD; i += 1) {
+            PD* p = &Process[i];
+
+            if ((p->state == SEND_BLOCK || p->state == REPLY_BLOCK) &&
+                p->server == server && p->priority < level) {
+                level = p->priority;
+            }
+        }
+
+        if (level == server->priority) {
+            return;
+        }
+
+        Set_Priority(server, level);
+
+        // A server waiting on another server passes its new priority on
+        if (server->state == SEND_BLOCK || server->state == REPLY_BLOCK) {
+            server = server->server;
+        } else {
+            server = NULL;
+        }
+    }
+}
+
+/**
+ * Blocks the running task in `state`, it won't be considered by Dispatch()
+ * until someone calls Ready_Enqueue() on it again.
+ */
+static void Block_Current(PROCESS_STATE state) {
+    Ready_Remove((PD*)Cp);
+    Cp->state = state;
+}
+
+/**
+ * Buffers an async message in `p`'s mailbox.
+ * Returns FALSE if it is full.
+ */
+static BOOL Mailbox_Put(PD* p, MTYPE type, uint16_t data, PID sender) {
+    ASYNC_MSG* slot;
+
+    if (p->mailbox_count >= p->mailbox_capacity) {
+        return FALSE;
+    }
+
+    slot = &p->mailbox[(p->mailbox_head + p->mailbox_count) % p->mailbox_capacity];
+    slot->type = type;
+    slot->data = data;
+    slot->sender = sender;
+    p->mailbox_count += 1;
+
+    return TRUE;
+}
+
+/**
+ * Removes the oldest message in `p`'s mailbox that matches `mask` into `msg`.
+ * Returns FALSE if there is no such message.
+ */
+static BOOL Mailbox_Take(PD* p, MASK mask, ASYNC_MSG* msg) {
+    uint8_t i, at, prev;
+
+    for (i = 0; i < p->mailbox_count; i += 1) {
+        at = (p->mailbox_head + i) % p->mailbox_capacity;
+
+        if (MASK_TEST_ANY(mask, p->mailbox[at].type)) {
+            *msg = p->mailbox[at];
+
+            // Skipped older messages move up into the gap, none when it was the oldest
+            for (; i > 0; i -= 1) {
+                prev = at > 0 ? at - 1 : p->mailbox_capacity - 1;
+                p->mailbox[at] = p->mailbox[prev];
+                at = prev;
+            }
+
+            p->mailbox_head = (p->mailbox_head + 1) % p->mailbox_capacity;
+            p->mailbox_count -= 1;
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+/**
+ * Adds the blocked task `p` to the sleep queue, to wake `ticks` TICKs from now.
+ * It goes behind the tasks that wake in the same TICK.
+ */
+static void Sleep_Insert(PD* p, TICK ticks) {
+    PD* prev = NULL;
+    PD* curr = sleep_queue;
+
+    while (curr != NULL && curr->sleep_delta <= ticks) {
+        ticks -= curr->sleep_delta;
+        prev = curr;
+        curr = curr->sleep_next;
+    }
+
+    p->sleep_delta = ticks;
+    p->sleep_next = curr;
+    p->sleeping = TRUE;
+
+    if (prev == NULL) {
+        sleep_queue = p;
+    } else {
+        prev->sleep_next = p;
+    }
+
+    // The task behind now counts from `p`
+    if (curr != NULL) {
+        curr->sleep_delta -= ticks;
+    }
+}
+
+/**
+ * Removes `p` from the sleep queue, if it is in it, because it was woken
+ * before its timeout
+ */
+static void Sleep_Cancel(PD* p) {
+    PD* prev = NULL;
+    PD* curr = sleep_queue;
+
+    if (!p->sleeping) {
+        return;
+    }
+
+    while (curr != p) {
+        prev = curr;
+        curr = curr->sleep_next;
+    }
+
+    if (prev == NULL) {
+        sleep_queue = p->sleep_next;
+    } else {
+        prev->sleep_next = p->sleep_next;
+    }
+
+    if (p->sleep_next != NULL) {
+        p->sleep_next->sleep_delta += p->sleep_delta;
+    }
+
+    p->sleep_next = NULL;
+    p->sleeping = FALSE;
+}
+
+/**
+ * The timeout of `p` is up. A sleeping task is ready again, a task that is still
+ * waiting to send or receive gives up, and gets TIMED_OUT back.
+ */
+static void Sleep_Expire(PD* p) {
+    PD* server;
+
+    switch (p->state) {
+        case SLEEP_BLOCK:
+            Ready_Enqueue(p);
+            break;
+
+        case RECV_BLOCK:
+            p->req_params->out_pid = TIMED_OUT;
+            Ready_Enqueue(p);
+            break;
+
+        case SEND_BLOCK:
+            // Take back the message, the server no longer inherits our priority
+            server = p->server;
+            msg_remove(&server->senders, &Messages[p->process_id]);
+            p->server = NULL;
+            p->req_params->out_pid = TIMED_OUT;
+            Ready_Enqueue(p);
+
+            if (server->state != DEAD) {
+                Inherit_Priority(server);
+            }
+            break;
+
+        default:
+            // Already received, a reply is always waited for
+            break;
+    }
+}
+
+/**
+ * Counts `ticks` elapsed TICKs off the sleep queue, and wakes the tasks that are due
+ */
+static void Sleep_Advance(TICK ticks) {
+    PD* p;
+
+    while (sleep_queue != NULL && sleep_queue->sleep_delta <= ticks) {
+        p = sleep_queue;
+        ticks -= p->sleep_delta;
+
+        sleep_queue = p->sleep_next;
+        p->sleep_next = NULL;
+        p->sleeping = FALSE;
+
+        Sleep_Expire(p);
+    }
+
+    if (sleep_queue != NULL) {
+        sleep_queue->sleep_delta -= ticks;
+    }
+}
+
+/**
+ * Returns the event group for the handle in the request, aborts if it isn't one
+ */
+static EVENT_GROUP* Request_Event() {
+    uint8_t e = request_info->handle;
+
+    if (e == 0 || e > MAXEVENT || !Events[e - 1].used) {
+        DIRECT_ABORT(INVALID_REQ_INFO);
+        return NULL;
+    }
+
+    return &Events[e - 1];
+}
+
+/**
+ * Returns the semaphore for the handle in the request, aborts if it isn't one
+ */
+static SEMAPHORE_CB* Request_Semaphore() {
+    uint8_t s = request_info->handle;
+
+    if (s == 0 || s > MAXSEM || !Semaphores[s - 1].used) {
+        DIRECT_ABORT(INVALID_REQ_INFO);
+        return NULL;
+    }
+
+    return &Semaphores[s - 1];
+}
+
+/**
+ * Returns the flags in `set` that satisfy a wait for all, or any, of `flags`,
+ * or 0 if the wait isn't satisfied yet
+ */
+static uint8_t Event_Match(uint8_t set, uint8_t flags, BOOL wait_all) {
+    uint8_t matched = set & flags;
+
+    if (wait_all ? matched != flags : matched == 0) {
+        return 0;
+    }
+
+    return matched;
+}
+
+/**
+ * Gives `p` a stack of at least `size` bytes. The smallest free block it fits
+ * is reused, and split if what's left over is a stack of its own. Otherwise the
+ * stack comes from the untouched top of the arena.
+ * Returns FALSE if there isn't room.
+ */
+static BOOL Stack_Alloc(PD* p, uint16_t size) {
+    STACK_BLOCK** link;
+    STACK_BLOCK** best = NULL;
+    STACK_BLOCK* block;
+
+    for (link = &free_stacks; *link != NULL; link = &(*link)->next) {
+        if ((*link)->size >= size && (best == NULL || (*link)->size < (*best)->size)) {
+            best = link;
+        }
+    }
+
+    if (best != NULL) {
+        block = *best;
+        *best = block->next;
+
+        if (block->size - size >= MIN_STACK) {
+            // The part above the new stack stays free
+            STACK_BLOCK* rest = (STACK_BLOCK*)((uint8_t*)block + size);
+            rest->size = block->size - size;
+            rest->next = free_stacks;
+            free_stacks = rest;
+        } else {
+            size = block->size;
+        }
+
+        p->workSpace = (uint8_t*)block;
+        p->stack_size = size;
+        return TRUE;
+    }
+
+    if (size > STACK_ARENA - stack_top) {
+        return FALSE;
+    }
+
+    p->workSpace = &StackArena[stack_top];
+    p->stack_size = size;
+    stack_top += size;
+    return TRUE;
+}
+
+/**
+ * Returns the stack of `p` to the arena. It is merged with the free blocks directly
+ * below and above it, so free neighbours make one block big enough for a larger stack.
+ * A block that then reaches the top of the arena gives its space back to the top.
+ */
+static void Stack_Free(PD* p) {
+    STACK_BLOCK* block = (STACK_BLOCK*)p->workSpace;
+    uint16_t size = p->stack_size;
+    STACK_BLOCK** link;
+
+    if (block == NULL) {
+        return;
+    }
+
+    p->workSpace = NULL;
+    p->stack_size = 0;
+
+    // Free blocks never border each other, so there is at most one of each
+    link = &free_stacks;
+    while (*link != NULL) {
+        if ((uint8_t*)*link + (*link)->size == (uint8_t*)block) {
+            size += (*link)->size;
+            block = *link;
+            *link = (*link)->next;
+        } else if ((uint8_t*)block + size == (uint8_t*)*link) {
+            size += (*link)->size;
+            *link = (*link)->next;
+        } else {
+            link = &(*link)->next;
+        }
+    }
+
+    if ((uint8_t*)block + size == &StackArena[stack_top]) {
+        stack_top -= size;
+        return;
+    }
+
+    block->size = size;
+    block->next = free_stacks;
+    free_stacks = block;
+}
+
+/**
+ * TRUE if the stack of `p` has run into its guard bytes
+ */
+static BOOL Stack_Overflowed(PD* p) {
+    uint8_t i;
+
+    if (p->sp < p->workSpace + STACK_GUARD) {
+        return TRUE;
+    }
+
+    for (i = 0; i < STACK_GUARD; i += 1) {
+        if (p->workSpace[i] != STACK_PATTERN) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/**
+ * Sets up the initial context of `p`, whose stack must already be allocated
+ */
 void Kernel_Task_Create_At(PD *p, taskfuncptr f) {
-    uint8_t *sp = &(p->workSpace[WORKSPACE - 1]);
+    uint8_t *sp = &(p->workSpace[p->stack_size - 1]);
 
-    //Clear the contents of the workspace
-    ZeroMemory(p->workSpace, WORKSPACE);
+    //Fill the workspace with the pattern its peak use is measured by
+    memset(p->workSpace, STACK_PATTERN, p->stack_size);
 
     //Notice that we are placing the address (16-bit) of the functions
     //onto the stack in reverse byte order (least significant first, followed
@@ -170,22 +747,88 @@ void Kernel_Task_Create_At(PD *p, taskfuncptr f) {
     *sp-- = HIGH_BYTE(f);
     *sp-- = LOW_BYTE(0);
 
-    //Place stack pointer at top of stack
-    sp = sp - 34;
+    //Place stack pointer at top of stack, above a lean frame for r2-r17
+    //and r28-r29, which start out holding STACK_PATTERN
+    sp = sp - 18;
 
     p->sp = sp;      /* stack pointer into the "workSpace" */
+    p->frame = FRAME_LEAN;
     p->code = f;     /* function to be executed as a task */
     p->state = READY;
 
     p->next = NULL;
     p->req_params = NULL;
+    msg_queue_init(&p->senders);
+}
+
+/**
+ * Greatest common divisor of two periods
+ */
+static TICK gcd(TICK a, TICK b) {
+    while (b != 0) {
+        TICK t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+/**
+ * Schedulability test for a new periodic task starting at `start` against all
+ * admitted periodic tasks. Each job of a task owns the window [tons, tons + wcet).
+ *
+ * Two tasks' windows only ever start d + k * gcd(T1, T2) ticks apart, where d is
+ * the difference of their starts modulo the gcd. So they never overlap over the
+ * hyperperiod iff wcet1 <= d <= gcd - wcet2, which is checked without walking
+ * the hyperperiod.
+ */
+static ADMIT_CODE Kernel_Admit_Periodic(TICK start, TICK period, TICK wcet) {
+    uint32_t utilization;
+    uint8_t i;
+
+    // A job needs at least the tick it is released in
+    TICK c = wcet > 0 ? wcet : 1;
+
+    // Utilization in units of 2^-16 of the CPU
+    utilization = ((uint32_t)c << 16) / period;
+
+    for (i = 0; i < periodic_tasks.length; i += 1) {
+        PD* p = periodic_tasks.tasks[i];
+        TICK pc = p->wcet > 0 ? p->wcet : 1;
+
+        utilization += ((uint32_t)pc << 16) / p->period;
+        if (utilization > 0x10000UL) {
+            return ADMIT_UTILIZATION;
+        }
+    }
+
+    for (i = 0; i < periodic_tasks.length; i += 1) {
+        PD* p = periodic_tasks.tasks[i];
+        TICK pc = p->wcet > 0 ? p->wcet : 1;
+        TICK g = gcd(period, p->period);
+
+        // Both starts are within 2^15 ticks of now, the new one ahead and p's either
+        // side if its job has started, so their difference needs more than 16 bits
+        int32_t diff = (int32_t)(TICK)(start - sys_clock) - (int16_t)(p->tons - sys_clock);
+        TICK d = ((diff % g) + g) % g;
+
+        if (d < pc || d + c > g) {
+            return ADMIT_CONFLICT;
+        }
+    }
+
+    return ADMIT_OK;
 }
 
 void Kernel_Task_Create() {
+    /* Every way of not creating the task below returns NO_PID, PID 0 is a task */
+    request_info->out_pid = NO_PID;
+
     if (Tasks >= MAXTHREAD) {
         /* Too many tasks! */
         /* Do not OS Abort because this error should be recoverable according to spec */
         LOG("WARN: Too many task created\n");
+        request_info->out_admit = ADMIT_NO_ROOM;
         return;
     }
 
@@ -194,6 +837,24 @@ void Kernel_Task_Create() {
         return;
     }
 
+    /* Refuse a periodic task that would conflict with the admitted ones */
+    if (ADMISSION_CONTROL && PERIODIC_POLICY == POLICY_RELEASE && request_info->priority == PERIODIC &&
+        request_info->period > 0 && request_info->wcet < request_info->period &&
+        request_info->period <= MAX_PERIOD && request_info->offset <= MAX_PERIOD) {
+
+        request_info->out_admit = Kernel_Admit_Periodic(
+            sys_clock + request_info->offset,
+            request_info->period,
+            request_info->wcet
+        );
+
+        if (request_info->out_admit != ADMIT_OK) {
+            /* Not an OS Abort, the caller gets the reason */
+            LOG("WARN: Periodic task not admitted (%d)\n", request_info->out_admit);
+            return;
+        }
+    }
+
     /* find a DEAD PD that we can use  */
     int x;
     for (x = 0; x < MAXTHREAD; x++) {
@@ -203,34 +864,69 @@ void Kernel_Task_Create() {
         }
     }
 
+    uint16_t stack = request_info->stack > 0 ? request_info->stack : WORKSPACE;
+    if (stack < MIN_STACK) {
+        DIRECT_ABORT(INVALID_REQ_INFO);
+        return;
+    }
+
+    if (x < MAXTHREAD && !Stack_Alloc(&Process[x], stack)) {
+        /* Recoverable like too many tasks, the caller gets NO_PID */
+        LOG("WARN: No room for a %u byte stack\n", stack);
+        request_info->out_admit = ADMIT_NO_ROOM;
+        return;
+    }
+
     /* Create the new task at dead process x.
      * Should have one since Tasks < MAXTHREAD */
     if (x < MAXTHREAD) {
         Kernel_Task_Create_At( &(Process[x]), request_info->code );
 
         Process[x].priority = request_info->priority;
+        Process[x].base_priority = request_info->priority;
+
+        if (request_info->buffer != NULL && request_info->length > 0) {
+            // Periodic tasks don't receive, and the ring indices are 8 bits
+            if (request_info->priority == PERIODIC || request_info->length > 0xFF) {
+                DIRECT_ABORT(INVALID_REQ_INFO);
+                return;
+            }
+
+            Process[x].mailbox = request_info->buffer;
+            Process[x].mailbox_capacity = request_info->length;
+        }
         Process[x].arg = request_info->arg;
 
         if (Process[x].priority == SYSTEM) {
 
-            enqueue(&system_tasks, &Process[x]);
+            Ready_Enqueue(&Process[x]);
 
         } else if (Process[x].priority == RR) {
 
             Process[x].ticks_remaining = 1;
 
-            enqueue(&rr_tasks, &Process[x]);
+            Ready_Enqueue(&Process[x]);
 
         } else if (Process[x].priority == PERIODIC) {
 
-            if (request_info->period > 0 && request_info->wcet < request_info->period) {
+            if (request_info->period > 0 && request_info->wcet < request_info->period &&
+                request_info->period <= MAX_PERIOD && request_info->offset <= MAX_PERIOD) {
                 Process[x].period = request_info->period;
                 Process[x].wcet = request_info->wcet;
                 Process[x].tons = sys_clock + request_info->offset;
+                Process[x].release = Process[x].tons;
                 Process[x].ticks_remaining = Process[x].wcet;
-                Process[x].clockState = clock_state;
 
-                insert(&periodic_tasks, &Process[x], sys_clock);
+                if (PERIODIC_POLICY == POLICY_TABLE) {
+                    // Tasks are created in the order of the table's task indices
+                    if (schedule_table == NULL || schedule_count > SLOT_TASK) {
+                        DIRECT_ABORT(INVALID_REQ_INFO);
+                        return;
+                    }
+                    schedule_tasks[schedule_count++] = &Process[x];
+                }
+
+                Ready_Enqueue(&Process[x]);
             } else {
                 DIRECT_ABORT(INVALID_REQ_INFO);
             }
@@ -250,55 +946,180 @@ void Kernel_Task_Create() {
 }
 
 /**
- * Finds and returns the first READY task in `queue`.
- * If no task is found, returns NULL and queue order is unchanged
- * If a task is found, `queue` will be rotated so that the READY task is
- * at the front.
+ * Called when only the idle task can run. Nothing becomes ready until a
+ * periodic task's next start, so instead of waking up every TICK to find
+ * nothing to do, TIMER4 is set to match once at that start (or as far as
+ * OCR4A can reach). Kernel_Request_Timer() catches the clock up.
  */
-PD* Queue_Rotate_Ready(task_queue_t* queue) {
-    // Get candidate task and first task in queue
-    PD* iter_task;
-    PD* first;
-    first = iter_task = peek(queue);
+static void Kernel_Clock_Skip() {
+    TICK skip = MAX_SKIP;
 
+    if (PERIODIC_POLICY == POLICY_TABLE && schedule_length > 0) {
+        // Ticks until the next slot that releases a job
+        TICK slot = schedule_slot;
 
-    // do-while so that the first loop doesn't break since first == new_p
-    do {
-        // Specify that the task has to be ready
-        if (iter_task->state != READY) {
-            // Move non-ready tasks to the end of the queue
-            // If this is a periodic queue, use insert
-            if (queue->type == PERIODIC) {
-                insert(queue, deque(queue), sys_clock);
-            } else {
-                enqueue(queue, deque(queue));
+        for (skip = 1; skip < MAX_SKIP; skip += 1) {
+            slot = slot + 1 < schedule_length ? slot + 1 : 0;
+            if (pgm_read_byte(&schedule_table[slot]) & SLOT_RELEASE) {
+                break;
             }
+        }
+    } else if (periodic_tasks.length > 0) {
+        // Ticks until the next start, unsigned subtraction handles overflow
+        TICK next = heap_peek(&periodic_tasks)->release - sys_clock;
+        if (next < skip) {
+            skip = next;
+        }
+    }
 
-            // Get the new head task
-            iter_task = peek(queue);
-        } else {
-            // task state is ready!
-            break;
+    // A sleeping task wakes before then
+    if (sleep_queue != NULL && sleep_queue->sleep_delta < skip) {
+        skip = sleep_queue->sleep_delta;
+    }
+
+    // Only from the start of a TICK, not while a resync is pending
+    if (skip > 1 && clock_skip == 1 && OCR4A == TICK_TOP) {
+        clock_skip = skip;
+        OCR4A = skip * TICK_COUNTS - 1;
+    }
+}
+
+/**
+ * Returns the periodic task that owns the current slot of the schedule table,
+ * or NULL if it has no job to run now. Aborts if the job should have started
+ * in an earlier slot.
+ */
+static PD* Schedule_Slot_Task() {
+    uint8_t slot;
+    PD* p;
+
+    if (schedule_length == 0) {
+        return NULL;
+    }
+
+    slot = pgm_read_byte(&schedule_table[schedule_slot]);
+    if (slot == SLOT_FREE) {
+        return NULL;
+    }
+
+    // The task might not exist, be past its first start, or have finished this job
+    p = schedule_tasks[slot & SLOT_TASK];
+    if (p == NULL || p->state != READY || (int16_t)(sys_clock - p->tons) < 0) {
+        return NULL;
+    }
+
+    if (p != schedule_job && (int16_t)(sys_clock - p->tons) > 0) {
+        // A periodic task must be run on its period
+        LOG("Missed starting time!\n");
+        DIRECT_ABORT(TIMING_VIOLATION);
+        return NULL;
+    }
+
+    schedule_job = p;
+    return p;
+}
+
+/**
+ * Called each TICK with POLICY_TABLE. A job may only run in the slots
+ * that follow its release slot, it has overrun once the slot isn't its own.
+ */
+static void Schedule_Advance(TICK ticks) {
+    uint8_t slot;
+
+    if (schedule_length == 0) {
+        return;
+    }
+
+    schedule_slot += ticks;
+    while (schedule_slot >= schedule_length) {
+        schedule_slot -= schedule_length;
+    }
+
+    if (schedule_job != NULL) {
+        slot = pgm_read_byte(&schedule_table[schedule_slot]);
+
+        if (slot == SLOT_FREE || (slot & SLOT_RELEASE) ||
+            schedule_tasks[slot & SLOT_TASK] != schedule_job) {
+            // Task ran over the slots the table gave it
+            LOG("Ran out of time!\n");
+            DIRECT_ABORT(TIMING_VIOLATION);
         }
-    } // Loop until the first task comes up again
-    while (iter_task != first);
+    }
+}
 
-    if (iter_task->state != READY) {
-        // Didn't find anything that was ready
-        iter_task = NULL;
+/**
+ * Called each TICK with POLICY_RM or POLICY_EDF. Moves the tasks whose next
+ * job is released to the released jobs. A job that is still unfinished at
+ * its deadline, the start of the task's next period, is a timing violation.
+ */
+static void Periodic_Release() {
+    uint8_t i;
+
+    while (periodic_tasks.length > 0 &&
+        (int16_t)(sys_clock - heap_peek(&periodic_tasks)->release) >= 0) {
+        heap_push(&periodic_jobs, heap_pop(&periodic_tasks));
     }
 
-    return iter_task;
+    for (i = 0; i < periodic_jobs.length; i += 1) {
+        PD* p = periodic_jobs.tasks[i];
+
+        if ((int16_t)(sys_clock - (p->tons + p->period)) >= 0) {
+            LOG("Missed deadline!\n");
+            DIRECT_ABORT(TIMING_VIOLATION);
+            return;
+        }
+    }
 }
 
 /**
- * This internal kernel function is a part of the "scheduler". It chooses the
- * next task to run, i.e., Cp.
+ * Counts `ticks` elapsed TICKs, and releases or wakes the tasks that are due
  */
-static void Dispatch() {
+static void Clock_Advance(TICK ticks) {
+    TICK before = sys_clock;
+
+    sys_clock += ticks;
+    if (sys_clock < before) {
+        sys_clock_hi += 1;
+    }
+
+    if (PERIODIC_POLICY == POLICY_TABLE) {
+        Schedule_Advance(ticks);
+    } else if (PREEMPTIVE_PERIODIC) {
+        Periodic_Release();
+    }
+
+    Sleep_Advance(ticks);
+}
+
+/**
+ * An interrupt made a task ready in the middle of a skip, see Kernel_Clock_Skip().
+ * Counts the TICKs that already passed, and moves the TIMER4 match to the end of
+ * the current TICK, so the task gets its usual TICKs from here on.
+ * Nothing is due before the skip ends, so catching up releases nothing.
+ */
+static void Kernel_Clock_Resync() {
+    TICK elapsed = (TICK)(((uint32_t)TCNT4 + RESYNC_MARGIN) / TICK_COUNTS);
+
+    if (elapsed + 1 >= clock_skip) {
+        // The pending match already ends this TICK
+        return;
+    }
+
+    OCR4A = (elapsed + 1) * TICK_COUNTS - 1;
+    clock_skip = 1;
+    clock_resynced = elapsed;
+    Clock_Advance(elapsed);
+}
+
+/**
+ * This internal kernel function is a part of the "scheduler". A task that gave up
+ * the CPU goes behind the other ready tasks of its level.
+ */
+static void Requeue_Current() {
     /* Move the current task to the end of it's queue */
     /* We use the invatiant that the running task is at the front of it's queue */
-    switch (Cp->priority) {
+    /* Blocked and dead tasks have already been removed from their queue */
+    switch (Cp->state == READY ? Cp->priority : NUM_PRIORITY_LEVELS) {
         case SYSTEM:
             if (system_tasks.length > 1) {
                 enqueue(&system_tasks, deque(&system_tasks));
@@ -306,9 +1127,11 @@ static void Dispatch() {
             break;
 
         case PERIODIC:
-            if (periodic_tasks.length > 1) {
-                insert(&periodic_tasks, deque(&periodic_tasks), sys_clock);
-            }
+            // Order Cp by its next start if it yielded, otherwise it has started,
+            // and any task that is due goes before it
+            Ready_Remove((PD*)Cp);
+            Cp->release = (int16_t)(Cp->tons - sys_clock) > 0 ? Cp->tons : sys_clock;
+            Ready_Enqueue((PD*)Cp);
             break;
 
         case RR:
@@ -317,6 +1140,10 @@ static void Dispatch() {
             }
             break;
 
+        case NUM_PRIORITY_LEVELS:
+            // Cp isn't in a queue, nothing to rotate
+            break;
+
         default:
             // Could have Cp == IdleProcess, in which case the priority isn't a normal value
             // Only abort if the CP isn't the idle process
@@ -326,57 +1153,131 @@ static void Dispatch() {
             }
         break;
     }
+}
 
+/**
+ * Chooses the task to run next, by priority, if Cp isn't RUNNING.
+ * A READY Cp is at the front of its queue, so it only loses the CPU to a
+ * higher priority task.
+ */
+static void Select_Next() {
+    /* An interrupt woke a task while idle, the pending TIMER4 match is too far away */
+    if (clock_skip > 1) {
+        Kernel_Clock_Resync();
+    }
 
     /* Only change the current task if it's not running */
     if (Cp->state != RUNNING ) {
         PD* new_p = NULL;
 
-        /* Check the system tasks */
-        if (system_tasks.length > 0) {
-            new_p = Queue_Rotate_Ready(&system_tasks);
+        /* Every queued system task is ready, the front one goes first */
+        if (BIT_TEST(ready_levels, SYSTEM)) {
+            new_p = peek(&system_tasks);
         }
 
-        /* Haven't found a new task */
-        if (new_p == NULL) {
+        /* The schedule table names the periodic task to run in this TICK */
+        else if (PERIODIC_POLICY == POLICY_TABLE && (new_p = Schedule_Slot_Task()) != NULL) {
+            ;
+        }
 
-            /* Check for periodic tasks which are ready to run, assuming sorted order
-               based on increasing time of next start, only need to check first task */
-            if (periodic_tasks.length > 0
-                && sys_clock >= peek(&periodic_tasks)->tons
-                && clock_state == peek(&periodic_tasks)->clockState
-            ) {
-                new_p = Queue_Rotate_Ready(&periodic_tasks);
-
-                if (new_p != NULL &&
-                  new_p->ticks_remaining == new_p->wcet &&
-                  sys_clock > new_p->tons &&
-                  clock_state == new_p->clockState) {
-                    // A periodic task must be run on its period
-                    LOG("Missed starting time!\n");
-                    DIRECT_ABORT(TIMING_VIOLATION);
-                    return;
-                }
+        /* The released job with the shortest period or earliest deadline runs,
+           it preempts any other periodic job */
+        else if (PREEMPTIVE_PERIODIC && periodic_jobs.length > 0) {
+            new_p = heap_peek(&periodic_jobs);
+        }
+
+        /* Check for periodic tasks which are ready to run, the release heap
+           keeps the task that should start next at the top */
+        else if (PERIODIC_POLICY == POLICY_RELEASE && BIT_TEST(ready_levels, PERIODIC)
+            && (int16_t)(sys_clock - heap_peek(&periodic_tasks)->release) >= 0
+        ) {
+            new_p = heap_peek(&periodic_tasks);
+
+            if (new_p->ticks_remaining == new_p->wcet &&
+              (int16_t)(sys_clock - new_p->tons) > 0) {
+                // A periodic task must be run on its period
+                LOG("Missed starting time!\n");
+                DIRECT_ABORT(TIMING_VIOLATION);
+                return;
             }
+        }
+
+        /* No periodic tasks should be started, every queued round robin task is ready */
+        else if (BIT_TEST(ready_levels, RR)) {
+            new_p = peek(&rr_tasks);
+        }
+
+        /* Nothing is ready to run! Use our lower-than-low priority task */
+        if (new_p == NULL) {
+            new_p = &IdleProcess;
 
-            /* No periodic tasks should be started, check round robin tasks now */
-            else if (rr_tasks.length > 0) {
-                /* Check all the round robin tasks */
-                new_p = Queue_Rotate_Ready(&rr_tasks);
+            if (TICKLESS) {
+                Kernel_Clock_Skip();
             }
         }
 
-        /* Nothing is ready to run! Use our lower-than-low priority task */
-        if (new_p == NULL) {
-            new_p = &IdleProcess;
-        }
+        /* Finally set the new task */
+        Cp = new_p;
+    }
+
+    CurrentSp = Cp->sp;
+    CurrentFrame = Cp->frame;
+    Cp->state = RUNNING;
+}
+
+/**
+ * TIMER4 counts since the last call. The kernel is entered at least once per
+ * compare match, so TCNT4 wraps at most once in between, at the current OCR4A.
+ * The timer handler only puts OCR4A back to TICK_TOP after the match is counted.
+ */
+static uint16_t Cpu_Elapsed() {
+    uint16_t now = TCNT4;
+    uint16_t elapsed = now >= cpu_stamp ? now - cpu_stamp : now + (OCR4A + 1) - cpu_stamp;
+
+    cpu_stamp = now;
+    return elapsed;
+}
+
+/**
+ * Charges `counts` to `p`, and to the current job of a PERIODIC task
+ */
+static void Cpu_Account(PD* p, uint16_t counts) {
+#if CPU_ACCOUNTING
+    p->cpu.cpu += counts;
+
+    if (p->priority == PERIODIC) {
+        p->job_counts = counts > 0xFFFF - p->job_counts ? 0xFFFF : p->job_counts + counts;
+    }
+#endif
+}
+
+/**
+ * Adds the job a PERIODIC task just finished to its statistics
+ */
+static void Cpu_Job_Done(PD* p) {
+#if CPU_ACCOUNTING
+    uint32_t bin = (uint32_t)p->job_counts * CPU_HIST_BINS / (p->period * TICK_COUNTS);
 
-        /* Finally set the new task */
-        Cp = new_p;
+    if (p->cpu.jobs == 0 || p->job_counts < p->cpu.job_min) {
+        p->cpu.job_min = p->job_counts;
+    }
+    if (p->job_counts > p->cpu.job_max) {
+        p->cpu.job_max = p->job_counts;
     }
 
-    CurrentSp = Cp->sp;
-    Cp->state = RUNNING;
+    p->cpu.job_hist[bin < CPU_HIST_BINS ? bin : CPU_HIST_BINS - 1] += 1;
+    p->cpu.jobs += 1;
+    p->job_counts = 0;
+#endif
+}
+
+/**
+ * This internal kernel function is a part of the "scheduler". It chooses the
+ * next task to run, i.e., Cp.
+ */
+static void Dispatch() {
+    Requeue_Current();
+    Select_Next();
 }
 
 void Kernel_Request_Create() {
@@ -387,7 +1288,6 @@ void Kernel_Request_Create() {
 }
 
 void Kernel_Request_Next() {
-    TICK prev_tons;
     switch (Cp->priority) {
         case SYSTEM:
             // System task yielded, nothing to do
@@ -395,13 +1295,16 @@ void Kernel_Request_Next() {
 
         case PERIODIC:
             // The task yieleded, make it ready for next time
-            prev_tons = Cp->tons;
+            // Dispatch() moves it to its new place in the release heap
             Cp->tons += Cp->period;
             Cp->ticks_remaining = Cp->wcet;
 
-            // Overflow
-            if (Cp->tons < prev_tons) {
-                Cp->clockState = Cp->clockState == EVEN ? ODD : EVEN;
+            if (Cp == schedule_job) {
+                schedule_job = NULL;
+            }
+
+            if (CPU_ACCOUNTING) {
+                Cpu_Job_Done((PD*)Cp);
             }
         break;
 
@@ -431,38 +1334,46 @@ void Kernel_Request_Abort() {
 }
 
 void Kernel_Request_Terminate() {
+    uint8_t i;
+
     /* deallocate all resources used by this task */
     /* Assume it will be at the front of it's queue? */
-    PD* killed_task = NULL;
-    switch (Cp->priority) {
-        case SYSTEM:
-            killed_task = deque(&system_tasks);
-            break;
-        case PERIODIC:
-            killed_task = deque(&periodic_tasks);
-            break;
-        case RR:
-            killed_task = deque(&rr_tasks);
-            break;
-        default:
-            DIRECT_ABORT(INVALID_PRIORITY);
-            return;
-            break;
-    }
+    Ready_Remove((PD*)Cp);
 
-    if (killed_task != Cp) {
-        DIRECT_ABORT(WRONG_TASK_ORDER);
-        return;
+    // Its slots in the schedule table become free
+    if (Cp == schedule_job) {
+        schedule_job = NULL;
+    }
+    for (i = 0; i < schedule_count; i += 1) {
+        if (schedule_tasks[i] == Cp) {
+            schedule_tasks[i] = NULL;
+        }
     }
 
     // Remove any messages being sent to this process
-    MSG *msg = msg_find_receiver(&msg_queue, Cp->process_id, ANY);
-    while (msg != NULL) {
-        msg = msg_find_receiver(&msg_queue, Cp->process_id, ANY);
+    while (Cp->senders.length > 0) {
+        msg_deque((msg_queue_t*)&Cp->senders);
+    }
+
+    // Its clients fail, instead of waiting on whichever task gets the PD next
+    for (i = 0; i < MAXTHREAD; i += 1) {
+        PD* p = &Process[i];
+
+        if ((p->state == SEND_BLOCK || p->state == REPLY_BLOCK) && p->server == Cp) {
+            Sleep_Cancel(p);
+            p->server = NULL;
+            p->req_params->out_pid = TIMED_OUT;
+            p->req_params->length = 0;
+            Ready_Enqueue(p);
+        }
     }
 
     Cp->state = DEAD;
     Tasks -= 1;
+
+    // Nothing runs on the stack again, the kernel has its own
+    Stack_Free((PD*)Cp);
+
     Dispatch();
 }
 
@@ -490,11 +1401,16 @@ void Kernel_Request_MsgSend() {
     // Check if info.msg_to is waiting for a message of same type
     if (p_recv->state == RECV_BLOCK && MASK_TEST_ANY(recv_mask, request_info->msg_mask)) {
         // If yes, change state of waiting process to ready and sender to reply block
-        p_recv->state = READY;
-        Cp->state = REPLY_BLOCK;
+        Sleep_Cancel(p_recv);
+        Ready_Enqueue(p_recv);
+        Block_Current(REPLY_BLOCK);
+        Cp->server = p_recv;
+        Inherit_Priority(p_recv);
 
         // Add the message data and pid of sender to the receiving processes request info
+        // The receiver borrows the sender's buffer until it replies, nothing is copied
         p_recv->req_params->msg_ptr_data = request_info->msg_ptr_data;
+        p_recv->req_params->length = request_info->length;
         p_recv->req_params->out_pid = Cp->process_id;
     } else {
         // If not, sender process goes to send block state
@@ -502,14 +1418,21 @@ void Kernel_Request_MsgSend() {
 
         // Save message
         msg->data = request_info->msg_ptr_data;
+        msg->length = request_info->length;
         msg->mask = request_info->msg_mask;
-        msg->receiver = request_info->msg_to;
         msg->sender = Cp->process_id;
 
         // Add message to message queue
-        msg_enqueue(&msg_queue, msg);
+        msg_enqueue(&p_recv->senders, msg);
 
-        Cp->state = SEND_BLOCK;
+        Block_Current(SEND_BLOCK);
+        Cp->server = p_recv;
+        Inherit_Priority(p_recv);
+
+        // Give up if it isn't received in time
+        if (request_info->timeout > 0) {
+            Sleep_Insert((PD*)Cp, request_info->timeout);
+        }
     }
 
     Dispatch();
@@ -523,27 +1446,41 @@ void Kernel_Request_MsgRecv() {
     }
 
     // Get the first message that was sent to this process
-    MSG *msg = msg_find_receiver(&msg_queue, Cp->process_id, request_info->msg_mask);
+    MSG *msg = msg_find((msg_queue_t*)&Cp->senders, request_info->msg_mask);
+    ASYNC_MSG async;
 
     // Check if there is a message waiting for this process
     if (msg != NULL) {
         // If yes, change state to ready and set msg data on Cp's request info
         request_info->msg_ptr_data = msg->data;
+        request_info->length = msg->length;
         request_info->out_pid = msg->sender;
 
         Cp->state = READY;
 
-        // Sender process now waiting for reply
+        // Sender process now waiting for reply, however long it takes
         PD *sender = &Process[msg->sender];
         sender->state = REPLY_BLOCK;
+        Sleep_Cancel(sender);
 
         // Remove data from Messages
         msg->data = NULL;
-        msg->receiver = -1;
         msg->sender = -1;
+    } else if (Mailbox_Take((PD*)Cp, request_info->msg_mask, &async)) {
+        // Drain an async message that arrived while we were busy, no reply is needed
+        request_info->msg_ptr_data = NULL;
+        request_info->length = 0;
+        request_info->msg_data = async.data;
+        request_info->out_pid = async.sender;
+
+        Cp->state = READY;
     } else {
         // If not, set process to receive block state
-        Cp->state = RECV_BLOCK;
+        Block_Current(RECV_BLOCK);
+
+        if (request_info->timeout > 0) {
+            Sleep_Insert((PD*)Cp, request_info->timeout);
+        }
     }
 
     Dispatch();
@@ -569,11 +1506,27 @@ void Kernel_Request_MsgRply() {
         return;
     }
 
-    // Check if process replying to is in reply block state
-    if (p_recv->state == REPLY_BLOCK) {
-        p_recv->state = READY;
+    // Check if process replying to is in reply block state, waiting on us.
+    // Only the receiver holds the sender's buffer, so only it may reply
+    if (p_recv->state == REPLY_BLOCK && p_recv->server == Cp) {
+        // The reply was written in place, it can't be longer than the buffer
+        if (request_info->length > p_recv->req_params->length) {
+            DIRECT_ABORT(MSG_OVERRUN);
+            return;
+        }
+
+        // A Rply() brings its word, a Rply_Buf() wrote its reply in place already
+        if (request_info->msg_ptr_data != NULL) {
+            memcpy(p_recv->req_params->msg_ptr_data, request_info->msg_ptr_data, request_info->length);
+        }
+
+        Ready_Enqueue(p_recv);
+        p_recv->server = NULL;
 
-        p_recv->req_params->msg_data = request_info->msg_data;
+        // The server no longer inherits the replied task's priority
+        Inherit_Priority((PD*)Cp);
+
+        p_recv->req_params->length = request_info->length;
     } else {
         // If not, noop
     }
@@ -583,11 +1536,15 @@ void Kernel_Request_MsgRply() {
     Dispatch();
 }
 
-void Kernel_Request_MsgASend() {
+/**
+ * Delivers the async message in the request from `sender` to its receiver, or
+ * buffers it in the receiver's mailbox. Returns TRUE if the receiver was woken.
+ */
+static BOOL Async_Deliver(PID sender) {
     // Check if process id is valid
     if (!VALID_ID(request_info->msg_to)) {
         DIRECT_ABORT(INVALID_REQ_INFO);
-        return;
+        return FALSE;
     }
 
     PD *p_recv = &Process[request_info->msg_to];
@@ -595,13 +1552,14 @@ void Kernel_Request_MsgASend() {
 
     // If sending to non-existent process, noop
     if (p_recv->state == DEAD) {
-        return;
+        return FALSE;
     }
 
     // Check if info.msg_to is waiting for a message of same type
     if (p_recv->state == RECV_BLOCK && MASK_TEST_ANY(recv_mask, request_info->msg_mask)) {
         // If yes, change state of waiting process to ready and sender to reply block
-        p_recv->state = READY;
+        Sleep_Cancel(p_recv);
+        Ready_Enqueue(p_recv);
 
         // Add the message data and pid of sender to the receiving processes request info
         p_recv->req_params->msg_data = request_info->msg_data;
@@ -609,15 +1567,237 @@ void Kernel_Request_MsgASend() {
         // Since the sender passes data by value, we need to set the data ptr to NULL
         // so the receiver knows to look at the msg_data instead
         p_recv->req_params->msg_ptr_data = NULL;
-        p_recv->req_params->out_pid = Cp->process_id;
+        p_recv->req_params->length = 0;
+        p_recv->req_params->out_pid = sender;
+
+        return TRUE;
+    } else if (p_recv->mailbox_capacity > 0 &&
+               !Mailbox_Put(p_recv, request_info->msg_mask, request_info->msg_data, sender)) {
+        // If not, buffer it, or count it as lost if the mailbox has no room
+        if (p_recv->dropped < 0xFFFF) {
+            p_recv->dropped += 1;
+        }
+    }
+
+    return FALSE;
+}
 
-        // Dispatch because awaiting process might be higher priority
+void Kernel_Request_MsgASend() {
+    // Dispatch because awaiting process might be higher priority
+    if (Async_Deliver(Cp->process_id)) {
         Dispatch();
-    } else {
-        // If not, noop
     }
 }
 
+void Kernel_Request_ISR_ASend() {
+    // Cp was interrupted, it didn't give up the CPU, so it keeps its place
+    // and only a higher priority receiver runs instead, right away
+    if (Async_Deliver(ISR_PID)) {
+        Select_Next();
+    }
+}
+
+void Kernel_Request_MsgDropped() {
+    if (!VALID_ID(request_info->msg_to)) {
+        request_info->msg_data = 0;
+        return;
+    }
+
+    request_info->msg_data = Process[request_info->msg_to].dropped;
+}
+
+void Kernel_Request_EventCreate() {
+    uint8_t i;
+
+    for (i = 0; i < MAXEVENT; i += 1) {
+        if (!Events[i].used) {
+            Events[i].used = TRUE;
+            Events[i].flags = 0;
+            queue_init(&Events[i].waiting, WAIT_QUEUE);
+            request_info->handle = i + 1;
+            return;
+        }
+    }
+
+    LOG("WARN: Too many event groups created\n");
+    request_info->handle = 0;
+}
+
+/**
+ * Sets the request's flags in its event group, and wakes the waiters that are
+ * satisfied now. Returns TRUE if any was woken.
+ */
+static BOOL Event_Set_Flags() {
+    EVENT_GROUP* group = Request_Event();
+    BOOL woken = FALSE;
+    uint8_t matched;
+    PD *p, *next;
+
+    if (group == NULL) {
+        return FALSE;
+    }
+
+    group->flags |= (uint8_t)request_info->value;
+
+    // Wake the waiters that are satisfied now, in queue order, each one
+    // consumes the flags it waited for
+    for (p = group->waiting.head; p != NULL && group->flags != 0; p = next) {
+        next = p->next;
+        matched = Event_Match(group->flags, p->req_params->value, p->req_params->wait_all);
+
+        if (matched != 0) {
+            group->flags &= ~matched;
+            queue_remove(&group->waiting, p);
+            p->req_params->value = matched;
+            Ready_Enqueue(p);
+            woken = TRUE;
+        }
+    }
+
+    return woken;
+}
+
+void Kernel_Request_EventSet() {
+    // Dispatch because a woken task might be higher priority
+    if (Event_Set_Flags()) {
+        Dispatch();
+    }
+}
+
+void Kernel_Request_ISR_EventSet() {
+    // Like Kernel_Request_ISR_ASend(), the interrupted task keeps its place
+    if (Event_Set_Flags()) {
+        Select_Next();
+    }
+}
+
+void Kernel_Request_EventWait() {
+    EVENT_GROUP* group = Request_Event();
+    uint8_t matched;
+
+    if (group == NULL) {
+        return;
+    }
+
+    // Periodic tasks must not block, or they would miss their schedule
+    if (Cp->priority == PERIODIC) {
+        DIRECT_ABORT(PERIODIC_WAIT);
+        return;
+    }
+
+    matched = Event_Match(group->flags, request_info->value, request_info->wait_all);
+    if (matched != 0) {
+        group->flags &= ~matched;
+        request_info->value = matched;
+        return;
+    }
+
+    Block_Current(EVENT_BLOCK);
+    wait_enqueue(&group->waiting, (PD*)Cp);
+    Dispatch();
+}
+
+void Kernel_Request_SemCreate() {
+    uint8_t i;
+
+    for (i = 0; i < MAXSEM; i += 1) {
+        if (!Semaphores[i].used) {
+            Semaphores[i].used = TRUE;
+            Semaphores[i].count = request_info->value;
+            queue_init(&Semaphores[i].waiting, WAIT_QUEUE);
+            request_info->handle = i + 1;
+            return;
+        }
+    }
+
+    LOG("WARN: Too many semaphores created\n");
+    request_info->handle = 0;
+}
+
+void Kernel_Request_SemWait() {
+    SEMAPHORE_CB* sem = Request_Semaphore();
+
+    if (sem == NULL) {
+        return;
+    }
+
+    if (Cp->priority == PERIODIC) {
+        DIRECT_ABORT(PERIODIC_WAIT);
+        return;
+    }
+
+    if (sem->count > 0) {
+        sem->count -= 1;
+        return;
+    }
+
+    Block_Current(SEM_BLOCK);
+    wait_enqueue(&sem->waiting, (PD*)Cp);
+    Dispatch();
+}
+
+/**
+ * Gives a unit of the request's semaphore back, directly to the first waiter if
+ * there is one. Returns TRUE if a waiter was woken.
+ */
+static BOOL Sem_Give() {
+    SEMAPHORE_CB* sem = Request_Semaphore();
+
+    if (sem == NULL) {
+        return FALSE;
+    }
+
+    // Hand the unit straight to the first waiter, if there is one
+    if (sem->waiting.length > 0) {
+        Ready_Enqueue(deque(&sem->waiting));
+        return TRUE;
+    }
+
+    if (sem->count < 0xFFFF) {
+        sem->count += 1;
+    }
+
+    return FALSE;
+}
+
+void Kernel_Request_SemSignal() {
+    if (Sem_Give()) {
+        Dispatch();
+    }
+}
+
+void Kernel_Request_ISR_SemSignal() {
+    // Like Kernel_Request_ISR_ASend(), the interrupted task keeps its place
+    if (Sem_Give()) {
+        Select_Next();
+    }
+}
+
+void Kernel_Request_Sleep() {
+    TICK ticks = request_info->timeout;
+
+    // Periodic tasks must not block, or they would miss their schedule
+    if (Cp->priority == PERIODIC) {
+        DIRECT_ABORT(PERIODIC_WAIT);
+        return;
+    }
+
+    if (request_info->request == SLEEP_UNTIL) {
+        // Already past, unsigned subtraction handles overflow
+        if ((int16_t)(ticks - sys_clock) <= 0) {
+            return;
+        }
+
+        ticks -= sys_clock;
+    } else if (ticks == 0) {
+        return;
+    }
+
+    Block_Current(SLEEP_BLOCK);
+    Sleep_Insert((PD*)Cp, ticks);
+    Dispatch();
+}
+
 void Kernel_Request_Timer() {
     switch (Cp->priority) {
         case SYSTEM:
@@ -627,6 +1807,12 @@ void Kernel_Request_Timer() {
 
         case PERIODIC:
             // Tick ended during periodic task
+            // The schedule table's slots are the budget instead, see Schedule_Advance(),
+            // or only missing a deadline is a violation, see Periodic_Release()
+            if (PERIODIC_POLICY != POLICY_RELEASE) {
+                break;
+            }
+
             Cp->ticks_remaining -= 1;
 
             if (Cp->ticks_remaining <= 0) {
@@ -657,12 +1843,13 @@ void Kernel_Request_Timer() {
     }
 
     // Clock ticked, increment the value
-    TICK prev_clock = sys_clock;
-    sys_clock += 1;
+    // If the idle task skipped ticks, this match accounts for all of them
+    Clock_Advance(clock_skip);
+    clock_resynced = 0;
 
-    // Detect clock overflow
-    if (sys_clock < prev_clock) {
-        clock_state = clock_state == EVEN ? ODD : EVEN;
+    if (OCR4A != TICK_TOP) {
+        clock_skip = 1;
+        OCR4A = TICK_TOP;
     }
 
     // You were running before the tick, so you're ready now
@@ -672,6 +1859,27 @@ void Kernel_Request_Timer() {
     Dispatch();
 }
 
+void Kernel_Request_Schedule_Table() {
+    uint8_t i;
+
+    if (request_info->table == NULL || request_info->period == 0) {
+        DIRECT_ABORT(INVALID_REQ_INFO);
+        return;
+    }
+
+    // The current TICK is slot 0, periodic tasks created after this
+    // are matched to the table's task indices in order
+    schedule_table = request_info->table;
+    schedule_length = request_info->period;
+    schedule_slot = 0;
+    schedule_count = 0;
+    schedule_job = NULL;
+
+    for (i = 0; i <= SLOT_TASK; i += 1) {
+        schedule_tasks[i] = NULL;
+    }
+}
+
 void Kernel_Request_GetArg() {
     request_info->arg = Cp->arg;
 }
@@ -703,6 +1911,19 @@ static void Next_Kernel_Request() {
         Kernel_Request_MsgRecv,
         Kernel_Request_MsgRply,
         Kernel_Request_MsgASend,
+        Kernel_Request_ISR_ASend,
+        Kernel_Request_MsgDropped,
+        Kernel_Request_Schedule_Table,
+        Kernel_Request_EventCreate,
+        Kernel_Request_EventSet,
+        Kernel_Request_ISR_EventSet,
+        Kernel_Request_EventWait,
+        Kernel_Request_SemCreate,
+        Kernel_Request_SemWait,
+        Kernel_Request_SemSignal,
+        Kernel_Request_ISR_SemSignal,
+        Kernel_Request_Sleep,
+        Kernel_Request_Sleep,
         Kernel_Request_Terminate,
         Kernel_Request_Abort
     };
@@ -724,9 +1945,20 @@ static void Next_Kernel_Request() {
 
         /* activate this newly selected task */
         CurrentSp = Cp->sp;
+        CurrentFrame = Cp->frame;
         KernelActive = 1;
+
+        if (CPU_ACCOUNTING) {
+            kernel_counts += Cpu_Elapsed();
+        }
+
         Exit_Kernel();    /* or CSwitch() */
 
+        /* charge Cp for the time since it was activated, the idle task included */
+        if (CPU_ACCOUNTING) {
+            Cpu_Account((PD*)Cp, Cpu_Elapsed());
+        }
+
         /* if this task makes a kernel request, it will return to here! */
         /* request_info should be valid again! */
         if (!request_info) {
@@ -736,6 +1968,13 @@ static void Next_Kernel_Request() {
 
         /* save the Cp's stack pointer */
         Cp->sp = CurrentSp;
+        Cp->frame = CurrentFrame;
+
+        /* catch an overflow at the switch it happened in */
+        if (Stack_Overflowed((PD*)Cp)) {
+            DIRECT_ABORT(STACK_OVERFLOW);
+            return;
+        }
 
         /* Switch current process state from RUNNING to READY */
         Cp->state = READY;
@@ -765,7 +2004,8 @@ void Kernel_Init_Clock() {
 
     // Set TOP value (0.01 seconds)
     // TODO: Adjust this based on MSECPERTICK definition
-    OCR4A = 625;
+    OCR4A = TICK_TOP;
+    clock_skip = 1;
 
     // Enable interupt A for timer 4.
     BIT_SET(TIMSK4, OCIE4A);
@@ -775,9 +2015,16 @@ void Kernel_Init_Clock() {
 }
 
 void Kernel_idle() {
+    set_sleep_mode(SLEEP_MODE_IDLE);
+
     for(;;) {
         // Kernel idle pin
         BIT_FLIP(PORTD, 0);
+
+        // Sleep until an interrupt, TIMER4 keeps running in idle mode
+        if (TICKLESS) {
+            sleep_mode();
+        }
     }
 }
 
@@ -788,7 +2035,18 @@ void Kernel_Init() {
     KernelActive = 0;
     NextP = 0;
     sys_clock = 0;
-    clock_state = EVEN;
+    sys_clock_hi = 0;
+    clock_resynced = 0;
+    ready_levels = 0;
+
+    schedule_table = NULL;
+    schedule_length = 0;
+    schedule_slot = 0;
+    schedule_count = 0;
+    schedule_job = NULL;
+    sleep_queue = NULL;
+    cpu_stamp = 0;
+    kernel_counts = 0;
 
     Kernel_Init_Clock();
 
@@ -796,8 +2054,13 @@ void Kernel_Init() {
     BIT_SET(DDRB, 7);
     BIT_CLR(PORTB, 7);
 
+    stack_top = 0;
+    free_stacks = NULL;
+
     // Clear the memory for the IdleProcess
+    // It only ever loops, so it gets the smallest stack
     ZeroMemory(IdleProcess, sizeof(PD));
+    Stack_Alloc(&IdleProcess, MIN_STACK);
     Kernel_Task_Create_At(&IdleProcess, Kernel_idle);
 
     // This process is not of normal priority
@@ -805,24 +2068,32 @@ void Kernel_Init() {
     // So we should be okay to set this to a non PRIORITY_LEVEL enum
     IdleProcess.priority = -1;
 
+    // Nothing has run yet, the first Dispatch() replaces the idle task
+    Cp = &IdleProcess;
+
     // Reminder: Clear the memory for the task on creation.
     for (x = 0; x < MAXTHREAD; x++) {
         ZeroMemory(Process[x], sizeof(PD));
         Process[x].state = DEAD;
-        Process[x].clockState = clock_state;
 
         ZeroMemory(Messages[x], sizeof(MSG));
         Messages[x].data = NULL;
-        Messages[x].receiver = -1;
         Messages[x].sender = -1;
         Messages[x].mask = 0x00;
     }
 
+    for (x = 0; x < MAXEVENT; x++) {
+        Events[x].used = FALSE;
+    }
+
+    for (x = 0; x < MAXSEM; x++) {
+        Semaphores[x].used = FALSE;
+    }
+
     queue_init(&system_tasks, SYSTEM);
     queue_init(&rr_tasks, RR);
-    queue_init(&periodic_tasks, PERIODIC);
-
-    msg_queue_init(&msg_queue);
+    heap_init(&periodic_tasks, HEAP_RELEASE);
+    heap_init(&periodic_jobs, PERIODIC_POLICY == POLICY_RM ? HEAP_PERIOD : HEAP_DEADLINE);
 
     // Add the setup system task
     KERNEL_REQUEST_PARAMS info = {
@@ -849,6 +2120,159 @@ void Kernel_Start() {
 }
 
 // THIS IS RUN IN USER MODE
+/**
+ * Cp is the calling task, and stays so while it runs, the interrupts only keep
+ * the 16 bit reads whole. sys_clock is only written by the kernel, with
+ * interrupts disabled, and it is exact while a task runs, see Kernel_Clock_Resync().
+ */
+int16_t Kernel_Read_Arg() {
+    uint8_t old_sreg = SREG;
+    int16_t arg;
+
+    OS_DI();
+    arg = Cp->arg;
+    SREG = old_sreg;
+
+    return arg;
+}
+
+PID Kernel_Read_Pid() {
+    uint8_t old_sreg = SREG;
+    PID pid;
+
+    OS_DI();
+    pid = Cp->process_id;
+    SREG = old_sreg;
+
+    return pid;
+}
+
+TICK Kernel_Read_Now() {
+    uint8_t old_sreg = SREG;
+    TICK now;
+
+    OS_DI();
+    now = sys_clock;
+    SREG = old_sreg;
+
+    return now;
+}
+
+/**
+ * The number of ticks since the kernel started, 32 bits wide
+ */
+uint32_t Kernel_Read_Now32() {
+    uint8_t old_sreg = SREG;
+    uint32_t now;
+
+    OS_DI();
+    now = ((uint32_t)sys_clock_hi << 16) | sys_clock;
+    SREG = old_sreg;
+
+    return now;
+}
+
+/**
+ * Microseconds since the kernel started, from the 32 bit tick count and TCNT4.
+ * TCNT4 counts from the last compare match, and a resync may already have added
+ * some of its ticks to sys_clock. A match whose interrupt is still pending
+ * (interrupts are disabled, or this is an ISR) hasn't been added yet.
+ */
+uint32_t Kernel_Read_Now_us() {
+    uint8_t old_sreg = SREG;
+    uint32_t ticks;
+    uint16_t counts;
+
+    OS_DI();
+    counts = TCNT4;
+    ticks = (((uint32_t)sys_clock_hi << 16) | sys_clock) - clock_resynced;
+    if ((TIFR4 & _BV(OCF4A)) && counts < (OCR4A >> 1)) {
+        // TCNT4 restarted at the match, which ends the resynced TICKs as well
+        ticks += clock_resynced + clock_skip;
+    }
+    SREG = old_sreg;
+
+    return (ticks * TICK_COUNTS + counts) * COUNT_USEC;
+}
+
+/**
+ * The most stack task `pid` has used so far, and its size, or 0 for both if
+ * there is no such task. The pattern is only ever overwritten, so the scan runs
+ * with interrupts on, and takes longest for a stack with room to spare.
+ */
+uint16_t Kernel_Read_Stack_Peak(PID pid, uint16_t* size) {
+    uint8_t old_sreg = SREG;
+    uint8_t* stack = NULL;
+    uint16_t i = 0;
+
+    *size = 0;
+
+    OS_DI();
+    if (VALID_ID(pid) && Process[pid].state != DEAD) {
+        stack = Process[pid].workSpace;
+        *size = Process[pid].stack_size;
+    }
+    SREG = old_sreg;
+
+    if (stack == NULL) {
+        return 0;
+    }
+
+    while (i < *size && stack[i] == STACK_PATTERN) {
+        i += 1;
+    }
+    return *size - i;
+}
+
+/**
+ * Copies the CPU use of task `pid` into `stats`.
+ * Returns FALSE if there is no such task, or without CPU_ACCOUNTING.
+ */
+BOOL Kernel_Read_Cpu_Stats(PID pid, CPU_STATS* stats) {
+    uint8_t old_sreg = SREG;
+    BOOL found = FALSE;
+
+    OS_DI();
+#if CPU_ACCOUNTING
+    if (VALID_ID(pid) && Process[pid].state != DEAD) {
+        *stats = Process[pid].cpu;
+        stats->period = Process[pid].priority == PERIODIC ? Process[pid].period : 0;
+        found = TRUE;
+    }
+#endif
+    SREG = old_sreg;
+
+    return found;
+}
+
+/**
+ * TIMER4 counts spent in the idle task and in the kernel since it started
+ */
+void Kernel_Read_Cpu_Totals(uint32_t* idle, uint32_t* kernel) {
+    uint8_t old_sreg = SREG;
+
+    OS_DI();
+#if CPU_ACCOUNTING
+    *idle = IdleProcess.cpu.cpu;
+#else
+    *idle = 0;
+#endif
+    *kernel = kernel_counts;
+    SREG = old_sreg;
+}
+
+/**
+ * Enters the kernel from an interrupt handler, the way the TIMER4 interrupt does.
+ * The interrupted task didn't make a request, so its req_params are left alone.
+ * Interrupts are already disabled in the handler.
+ */
+void Kernel_Request_From_ISR(KERNEL_REQUEST_PARAMS* info) {
+    if (KernelActive) {
+        request_info = info;
+        Enter_Kernel();
+    }
+}
+
 void Kernel_Request(KERNEL_REQUEST_PARAMS* info) {
     if (KernelActive) {
         OS_DI();
@@ -859,7 +2283,7 @@ void Kernel_Request(KERNEL_REQUEST_PARAMS* info) {
         // Save pointer to current processes request info so we can
         // return data to process after it has been cswitched out
         Cp->req_params = info;
-        Enter_Kernel();
+        Enter_Kernel_Lean();
     }
 }
 
@@ -9,5 +9,19 @@ int main(void) __attribute__ ((weak)); \
 int main(void) { }
 
 void Kernel_Request(KERNEL_REQUEST_PARAMS* info);
+void Kernel_Request_From_ISR(KERNEL_REQUEST_PARAMS* info);
+
+/**
+ * Read only queries about the calling task and the clock. They can't make another
+ * task ready, so they read the kernel's state in place instead of making a request.
+ */
+int16_t Kernel_Read_Arg(void);
+PID     Kernel_Read_Pid(void);
+TICK    Kernel_Read_Now(void);
+uint32_t Kernel_Read_Now32(void);
+uint32_t Kernel_Read_Now_us(void);
+uint16_t Kernel_Read_Stack_Peak(PID pid, uint16_t* size);
+BOOL    Kernel_Read_Cpu_Stats(PID pid, CPU_STATS* stats);
+void    Kernel_Read_Cpu_Totals(uint32_t* idle, uint32_t* kernel);
 
 #endif
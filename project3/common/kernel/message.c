@@ -52,28 +52,9 @@ void msg_enqueue (msg_queue_t* list, MSG* msg) {
 }
 
 /**
- * Finds and removes the first message for `receiver` matching the mask
- * Returns null if no message for receiver
+ * Unlinks `curr` from the queue, `prev` is the message in front of it, or NULL
  */
-MSG* msg_find_receiver (msg_queue_t* list, PID receiver, MASK mask) {
-    if (!(list && VALID_ID(receiver))) {
-        OS_Abort(QUEUEING_ERROR);
-        return NULL;
-    }
-
-    MSG* curr = list->head;
-    MSG* prev = NULL;
-
-    while (curr != NULL && !(curr->receiver == receiver && MASK_TEST_ANY(mask, curr->mask))) {
-        prev = curr;
-        curr = curr->next;
-    }
-
-    // No message was found
-    if (curr == NULL) {
-        return NULL;
-    }
-
+static void msg_unlink (msg_queue_t* list, MSG* prev, MSG* curr) {
     if (curr == list->head && curr == list->tail) {
         // Only 1 element in the list
         list->head = NULL;
@@ -92,6 +73,57 @@ MSG* msg_find_receiver (msg_queue_t* list, PID receiver, MASK mask) {
 
     curr->next = NULL;
     list->length -= 1;
+}
 
+/**
+ * Finds and removes the first message in a receiver's queue matching the mask
+ * Returns null if no message matches
+ */
+MSG* msg_find (msg_queue_t* list, MASK mask) {
+    if (!(list)) {
+        OS_Abort(QUEUEING_ERROR);
+        return NULL;
+    }
+
+    MSG* curr = list->head;
+    MSG* prev = NULL;
+
+    while (curr != NULL && !MASK_TEST_ANY(mask, curr->mask)) {
+        prev = curr;
+        curr = curr->next;
+    }
+
+    // No message was found
+    if (curr == NULL) {
+        return NULL;
+    }
+
+    msg_unlink(list, prev, curr);
     return curr;
 }
+
+/**
+ * Removes `msg` from a receiver's queue, if it is in it
+ * Returns TRUE if it was removed
+ */
+BOOL msg_remove (msg_queue_t* list, MSG* msg) {
+    if (!(list && msg)) {
+        OS_Abort(QUEUEING_ERROR);
+        return FALSE;
+    }
+
+    MSG* curr = list->head;
+    MSG* prev = NULL;
+
+    while (curr != NULL && curr != msg) {
+        prev = curr;
+        curr = curr->next;
+    }
+
+    if (curr == NULL) {
+        return FALSE;
+    }
+
+    msg_unlink(list, prev, curr);
+    return TRUE;
+}
@@ -5,9 +5,9 @@
 
 typedef struct msg_type {
     uint16_t* data;        /* The data being sent in a message */
+    uint16_t  length;      /* The size of the sender's buffer at `data`, in bytes */
     MASK      mask;        /* The mask for the specific message being sent */
     PID       sender;      /* The sender of the message */
-    PID       receiver;    /* The receiver of the message */
     struct msg_type* next;
 } MSG;
 
@@ -22,6 +22,7 @@ msg_queue_t* msg_queue_init(msg_queue_t* list);
 MSG* msg_peek (msg_queue_t* list);
 MSG* msg_deque (msg_queue_t* list);
 void msg_enqueue (msg_queue_t* list, MSG* msg);
-MSG* msg_find_receiver (msg_queue_t* list, PID receiver, MASK mask);
+MSG* msg_find (msg_queue_t* list, MASK mask);
+BOOL msg_remove (msg_queue_t* list, MSG* msg);
 
 #endif
@@ -3,13 +3,14 @@
 #include "utils.h"
 
 /**
- * Initializes a task queue for tracking a certain priority task.
+ * Initializes a task queue for tracking a certain priority task, or WAIT_QUEUE
+ * for tasks of any priority that are blocked on an event group or semaphore.
  * Returns a pointer to the initialized list if successful.
  */
 task_queue_t* queue_init(task_queue_t* list, PRIORITY_LEVEL type) {
     // Have a non-null pointer, and a valid priority type
     // All conditions inside inner-most parens must be true to continue
-    if (!(list && type < NUM_PRIORITY_LEVELS)) {
+    if (!(list && (type < NUM_PRIORITY_LEVELS || type == WAIT_QUEUE))) {
         utils_abort(QUEUEING_ERROR);
         return NULL;
     }
@@ -89,65 +90,274 @@ void enqueue(task_queue_t* list, PD* task) {
 }
 
 /**
- * Returns whether task t1 is scheduled later than task t2.
- * Takes into account the clock overflow state.
+ * Adds a task to the front of the queue iff the task type matches the queue type.
  */
-BOOL later(PD* t1, PD* t2) {
-    return ((t1->clockState != t2->clockState && t1->tons < t2->tons) ||
-            (t1->clockState == t2->clockState && t1->tons > t2->tons));
+void enqueue_front(task_queue_t* list, PD* task) {
+    // Have non-null list and task, and the queue type matches the task priority.
+    // All conditions inside inner-most parens must be true to continue
+    if (!(list && task && list->type == task->priority)) {
+        utils_abort(QUEUEING_ERROR);
+        return;
+    }
+
+    if (list->length == 0) {
+        list->tail = task;
+    }
+
+    task->next = list->head;
+    list->head = task;
+    list->length += 1;
 }
 
 /**
- * Inserts a task into the queue respecting time of next start,
- * This operation is only supported for PERIODIC queues
+ * Removes `task` from anywhere in the queue
  */
-void insert(task_queue_t* list, PD* task, TICK sys_clock) {
-    // Have a non-null list, and the queue type matches the task priority.
+void queue_remove(task_queue_t* list, PD* task) {
+    // Have non-null list and task
     // All conditions inside inner-most parens must be true to continue
-    if (!(list && task && list->type == task->priority && list->type == PERIODIC)) {
+    if (!(list && task)) {
         utils_abort(QUEUEING_ERROR);
         return;
     }
 
-    // No searching required, queue is empty
-    if (list->length == 0) {
-        enqueue(list, task);
+    PD* prev = NULL;
+    PD* curr = list->head;
+
+    while (curr != NULL && curr != task) {
+        prev = curr;
+        curr = curr->next;
+    }
+
+    // The task must be in the queue
+    if (curr == NULL) {
+        utils_abort(QUEUEING_ERROR);
+        return;
+    }
+
+    if (prev == NULL) {
+        list->head = task->next;
+    } else {
+        prev->next = task->next;
+    }
+
+    if (list->tail == task) {
+        list->tail = prev;
+    }
+
+    list->length -= 1;
+    task->next = NULL;
+}
+
+/**
+ * Adds a blocked task to a WAIT_QUEUE. With WAIT_BY_PRIORITY it goes behind the
+ * tasks of the same or higher priority, otherwise at the end.
+ * A blocked task isn't in a ready queue, so its `next` is free to link it in here.
+ */
+void wait_enqueue(task_queue_t* list, PD* task) {
+    // Have non-null list and task, and the queue is a wait queue
+    // All conditions inside inner-most parens must be true to continue
+    if (!(list && task && list->type == WAIT_QUEUE)) {
+        utils_abort(QUEUEING_ERROR);
+        return;
     }
 
-    // Queue has items, find the right place to insert
-    else {
-        PD* element = list->head;
-        PD* element_prev = NULL;
+    PD* prev = NULL;
+    PD* curr = list->head;
 
-        // Starting from the front, find the first element that
-        // this task should run before
-        while (element != NULL && (
-            later(task, element) || element->ticks_remaining < element->wcet || element->tons <= sys_clock
-        )) {
-            element_prev = element;
-            element = element->next;
+    if (WAIT_BY_PRIORITY) {
+        while (curr != NULL && curr->priority <= task->priority) {
+            prev = curr;
+            curr = curr->next;
         }
+    } else {
+        prev = list->tail;
+        curr = NULL;
+    }
+
+    task->next = curr;
+    if (prev == NULL) {
+        list->head = task;
+    } else {
+        prev->next = task;
+    }
+
+    if (curr == NULL) {
+        list->tail = task;
+    }
+
+    list->length += 1;
+}
 
-        // Task should run next, inserting at front
-        if (element_prev == NULL) {
-            list->head = task;
-            task->next = element;
+/**
+ * Initializes an empty heap ordered by `order`.
+ * Returns a pointer to the initialized heap if successful.
+ */
+task_heap_t* heap_init(task_heap_t* heap, HEAP_ORDER order) {
+    if (!(heap)) {
+        utils_abort(QUEUEING_ERROR);
+        return NULL;
+    }
+
+    heap->length = 0;
+    heap->order = order;
+
+    return heap;
+}
+
+/**
+ * Returns whether task t1 should run before task t2 in `heap`.
+ * Times are compared by their difference, which handles the clock overflowing.
+ * When both are released at the same time, a task that hasn't started this
+ * period goes first. Jobs with the same deadline run in the order their tasks
+ * were created.
+ */
+static BOOL before(task_heap_t* heap, PD* t1, PD* t2) {
+    int16_t diff;
+
+    if (heap->order == HEAP_RELEASE) {
+        diff = (int16_t)(t1->release - t2->release);
+
+        if (diff != 0) {
+            return diff < 0;
         }
 
-        // Task should run last, inserting at end
-        else if (element == NULL) {
-            list->tail = task;
-            element_prev->next = task;
-            task->next = NULL;
+        return (t1->ticks_remaining == t1->wcet) > (t2->ticks_remaining == t2->wcet);
+    }
+
+    if (heap->order == HEAP_PERIOD && t1->period != t2->period) {
+        return t1->period < t2->period;
+    }
+
+    diff = (int16_t)((t1->tons + t1->period) - (t2->tons + t2->period));
+
+    if (diff != 0) {
+        return diff < 0;
+    }
+
+    return t1->process_id < t2->process_id;
+}
+
+/**
+ * Places `task` at index `i` of the heap
+ */
+static void heap_place(task_heap_t* heap, uint8_t i, PD* task) {
+    heap->tasks[i] = task;
+    task->heap_index = i;
+}
+
+/**
+ * Moves the task at index `i` towards the root until its parent starts before it
+ */
+static void heap_sift_up(task_heap_t* heap, uint8_t i) {
+    PD* task = heap->tasks[i];
+
+    while (i > 0) {
+        uint8_t parent = (i - 1) / 2;
+        if (!before(heap, task, heap->tasks[parent])) {
+            break;
         }
 
-        // Task runs before some element and after other,
-        // inserting between existing elements
-        else {
-            task->next = element;
-            element_prev->next = task;
+        heap_place(heap, i, heap->tasks[parent]);
+        i = parent;
+    }
+
+    heap_place(heap, i, task);
+}
+
+/**
+ * Moves the task at index `i` towards the leaves until it starts before both children
+ */
+static void heap_sift_down(task_heap_t* heap, uint8_t i) {
+    PD* task = heap->tasks[i];
+
+    for (;;) {
+        uint8_t child = 2 * i + 1;
+        if (child >= heap->length) {
+            break;
         }
 
-        list->length += 1;
+        // Follow the child that starts first
+        if (child + 1 < heap->length && before(heap, heap->tasks[child + 1], heap->tasks[child])) {
+            child += 1;
+        }
+
+        if (!before(heap, heap->tasks[child], task)) {
+            break;
+        }
+
+        heap_place(heap, i, heap->tasks[child]);
+        i = child;
+    }
+
+    heap_place(heap, i, task);
+}
+
+/**
+ * Peeks at the task that should run next
+ * Returns the task without removing it, or NULL if the heap is empty
+ */
+PD* heap_peek(task_heap_t* heap) {
+    if (!(heap)) {
+        utils_abort(QUEUEING_ERROR);
+        return NULL;
+    }
+
+    return heap->length > 0 ? heap->tasks[0] : NULL;
+}
+
+/**
+ * Removes the task that should run next from the heap
+ * Returns the removed task or NULL if the heap is empty
+ */
+PD* heap_pop(task_heap_t* heap) {
+    // Have a non-null heap, and its length is greater than 0
+    // All conditions inside inner-most parens must be true to continue
+    if (!(heap && heap->length > 0)) {
+        utils_abort(QUEUEING_ERROR);
+        return NULL;
+    }
+
+    PD* task = heap->tasks[0];
+    heap_remove(heap, task);
+
+    return task;
+}
+
+/**
+ * Adds a PERIODIC task to the heap, in the heap's order
+ */
+void heap_push(task_heap_t* heap, PD* task) {
+    // Have a non-null heap and task, the task is periodic, and there is space left
+    // All conditions inside inner-most parens must be true to continue
+    if (!(heap && task && task->priority == PERIODIC && heap->length < MAXTHREAD)) {
+        utils_abort(QUEUEING_ERROR);
+        return;
+    }
+
+    heap->tasks[heap->length] = task;
+    heap->length += 1;
+    heap_sift_up(heap, heap->length - 1);
+}
+
+/**
+ * Removes `task` from anywhere in the heap
+ */
+void heap_remove(task_heap_t* heap, PD* task) {
+    // Have a non-null heap and task, and the task is in this heap
+    // All conditions inside inner-most parens must be true to continue
+    if (!(heap && task && task->heap_index < heap->length && heap->tasks[task->heap_index] == task)) {
+        utils_abort(QUEUEING_ERROR);
+        return;
+    }
+
+    uint8_t i = task->heap_index;
+    heap->length -= 1;
+
+    // Fill the hole with the last task, it may need to move either way
+    if (i < heap->length) {
+        PD* last = heap->tasks[heap->length];
+        heap_place(heap, i, last);
+        heap_sift_up(heap, i);
+        heap_sift_down(heap, last->heap_index);
     }
 }
@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include "common.h"
+#include "message.h"
 
 /**
  * Each task is represented by a process descriptor, which contains all
@@ -11,21 +12,52 @@
  */
 typedef struct ProcessDescriptor {
     volatile uint8_t*         sp;                   /* stack pointer into the "workSpace" */
-    uint8_t                   workSpace[WORKSPACE];
+    uint8_t                   frame;                /* How the context at sp was saved, FRAME_FULL or FRAME_LEAN */
+    uint8_t*                  workSpace;            /* The task's stack, carved from the kernel's stack arena */
+    uint16_t                  stack_size;           /* Bytes at workSpace */
     volatile PROCESS_STATE    state;
     taskfuncptr               code;                 /* function to be executed as a task  */
     int16_t                   arg;                  /* parameter to be passed to the task */
     PID                       process_id;
-    PRIORITY_LEVEL            priority;
+    PRIORITY_LEVEL            priority;             /* The level the task is queued at, raised while it serves a higher priority sender */
+    PRIORITY_LEVEL            base_priority;        /* The level the task was created with */
+    struct ProcessDescriptor* server;               /* The task a SEND_BLOCK or REPLY_BLOCK task waits on */
+    msg_queue_t               senders;              /* Messages in Messages from SEND_BLOCK tasks to this task, Recv() takes the first that matches */
+    ASYNC_MSG*                mailbox;              /* Ring of Msg_ASend() messages that arrived while not RECV_BLOCK */
+    uint8_t                   mailbox_capacity;
+    uint8_t                   mailbox_head;         /* Index of the oldest message in the ring */
+    uint8_t                   mailbox_count;
+    uint16_t                  dropped;              /* Msg_ASend() messages lost because the mailbox was full */
     TICK                      period;               /* The period of a PERIODIC task */
     TICK                      wcet;                 /* The worst case execution time of a PERIODIC task */
     TICK                      tons;                 /* The time of the next start for a PERIODIC task */
     TICK                      ticks_remaining;      /* Until a PERIODIC or RR task is forced to yield */
-    volatile OVERFLOW_STATE clockState;             /* The EVEN or ODD state of the clock tons is in */
+    TICK                      release;              /* The time a PERIODIC task is ordered by in the release heap */
+    uint8_t                   heap_index;           /* The position of a PERIODIC task in the release heap */
     struct ProcessDescriptor* next;
+    struct ProcessDescriptor* sleep_next;           /* The task that wakes after this one in the sleep queue */
+    TICK                      sleep_delta;          /* TICKs between the wake up of the task in front in the sleep queue and this one */
+    BOOL                      sleeping;             /* Whether the task is in the sleep queue */
+#if CPU_ACCOUNTING
+    CPU_STATS                 cpu;                  /* TIMER4 counts the task has run for */
+    uint16_t                  job_counts;           /* TIMER4 counts the current PERIODIC job has run for */
+#endif
     volatile KERNEL_REQUEST_PARAMS *req_params;
 } PD;
 
+/**
+ * A task preempted by an interrupt has all of its registers and SREG saved on its
+ * stack. A task that made a request only has the ones a C function must preserve.
+ * The values are shared with cswitch.S.
+ */
+#define FRAME_FULL 0
+#define FRAME_LEAN 1
+
+/**
+ * The type of a queue of blocked tasks of any priority, see wait_enqueue()
+ */
+#define WAIT_QUEUE (PRIORITY_LEVEL)(NUM_PRIORITY_LEVELS + 1)
+
 typedef struct task_queue_type {
     PD* head;
     PD* tail;
@@ -33,11 +65,40 @@ typedef struct task_queue_type {
     PRIORITY_LEVEL type;
 } task_queue_t;
 
+/**
+ * What a task heap orders its PERIODIC tasks by
+ */
+typedef enum heap_order {
+    HEAP_RELEASE = 0,   /* `release`, the time the task should start next */
+    HEAP_DEADLINE,      /* `tons + period`, the deadline of the task's current job */
+    HEAP_PERIOD         /* `period`, shortest first, then by deadline */
+} HEAP_ORDER;
+
+/**
+ * A binary min-heap of PERIODIC tasks, by default ordered by release time, so
+ * the task that should start next is always at index 0. Times are compared
+ * relative to each other, so they must all be less than 2^15 TICKs apart.
+ */
+typedef struct task_heap_type {
+    PD* tasks[MAXTHREAD];
+    uint8_t length;
+    HEAP_ORDER order;
+} task_heap_t;
+
 task_queue_t* queue_init(task_queue_t* list, PRIORITY_LEVEL type);
 
 PD*  peek   (task_queue_t* list);
 PD*  deque  (task_queue_t* list);
 void enqueue(task_queue_t* list, PD* task);
-void insert (task_queue_t* list, PD* task, TICK sys_clock);
+void enqueue_front(task_queue_t* list, PD* task);
+void queue_remove (task_queue_t* list, PD* task);
+void wait_enqueue (task_queue_t* list, PD* task);
+
+task_heap_t* heap_init(task_heap_t* heap, HEAP_ORDER order);
+
+PD*  heap_peek  (task_heap_t* heap);
+PD*  heap_pop   (task_heap_t* heap);
+void heap_push  (task_heap_t* heap, PD* task);
+void heap_remove(task_heap_t* heap, PD* task);
 
 #endif
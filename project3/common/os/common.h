@@ -61,10 +61,50 @@
 #define TRUE         true                /* stdbool types */
 #define FALSE        false               /* stdbool is a very light-weight header */
 #define ANY          0xFF                /* A mask for ALL message types */
+#define TIMED_OUT    0xFFFF              /* The PID returned when a wait with a timeout gives up */
+#define ISR_PID      0xFFFE              /* The sender PID of messages from Msg_ASend_ISR() */
+#define NO_PID       0xFFFD              /* The PID a Task_Create function returns when it created no task */
 
 #define MAXTHREAD    16                  /* Maximum supported threads */
-#define WORKSPACE    256                 /* in bytes, per THREAD */
+#define WORKSPACE    256                 /* in bytes, the stack of a THREAD unless Task_Create_Stack() says otherwise */
+#define MIN_STACK    128                 /* in bytes, the smallest stack a THREAD is given, room to be preempted */
+#ifndef STACK_ARENA
+#define STACK_ARENA  (MAXTHREAD * WORKSPACE + MIN_STACK) /* in bytes, the memory all THREAD stacks and idle's are carved from, each station's Makefile sizes it to its tasks */
+#endif
 #define MSECPERTICK  10                  /* resolution of a system TICK in milliseconds */
+#define COUNT_USEC   (256UL * 1000000UL / F_CPU) /* microseconds per TIMER4 count, it runs at F_CPU / 256 */
+#define TICK_TOP     625                 /* TIMER4 runs in CTC mode, one TICK is TICK_TOP + 1 timer counts */
+#define TICK_COUNTS  ((uint32_t)TICK_TOP + 1)
+#define MAX_PERIOD   0x7FFF              /* Longest period and offset, release times are compared by difference */
+#ifndef TICKLESS
+#define TICKLESS     1                   /* 1 to stop the TICK while idle until the next periodic start */
+#endif
+#define MAXEVENT     4                   /* Maximum supported event groups */
+#define MAXSEM       4                   /* Maximum supported semaphores */
+#define WAIT_BY_PRIORITY 1               /* 1 to wake waiting tasks highest priority first, 0 for first come first serve */
+
+#ifndef CPU_ACCOUNTING
+#define CPU_ACCOUNTING 0                 /* 1 to time each task's use of the CPU with TIMER4, see Task_Cpu_Stats() */
+#endif
+#define CPU_HIST_BINS 8                  /* Bins of PERIODIC job times, each 1/CPU_HIST_BINS of the period */
+#define WCET_MARGIN   25                 /* Percent added to the longest job by Task_Wcet_Recommend() */
+
+#ifndef ADMISSION_CONTROL
+#define ADMISSION_CONTROL 0              /* 1 to test that a new periodic task is schedulable before creating it, TEST builds set it */
+#endif
+
+#define POLICY_RELEASE 0                 /* PERIODIC tasks start in release order, and must never overlap */
+#define POLICY_TABLE   1                 /* PERIODIC tasks run in the slots of a table, see Task_Schedule_Table() */
+#define POLICY_RM      2                 /* PERIODIC jobs preempt each other, the shortest period runs first */
+#define POLICY_EDF     3                 /* PERIODIC jobs preempt each other, the earliest deadline runs first */
+
+#ifndef PERIODIC_POLICY
+#define PERIODIC_POLICY POLICY_RELEASE   /* How the kernel chooses which PERIODIC task runs */
+#endif
+
+#define SLOT_FREE    0xFF                /* Schedule table slot with no PERIODIC task */
+#define SLOT_RELEASE 0x80                /* Set in the first slot of each job */
+#define SLOT_TASK    0x0F                /* Index of the slot's task, in the order the tasks were created */
 
 #define FREE_MODE 0
 #define STAY_MODE 1
@@ -75,9 +115,20 @@ typedef uint16_t     TICK;               /* Tick type: Length of 1 TICK is defin
 typedef bool         BOOL;               /* Boolean type: C99 introduced _Bool */
 typedef uint8_t      MTYPE;              /* Message type: used to classify messages */
 typedef uint8_t      MASK;               /* Message Mask type: used to filter messages by type */
+typedef uint8_t      EVENT;              /* Event group handle: always non-zero if it is valid */
+typedef uint8_t      SEMAPHORE;          /* Semaphore handle: always non-zero if it is valid */
 
 typedef void (*taskfuncptr) (void);      /* pointer to void f(void) */
 
+/**
+ * A message buffered by Msg_ASend() in a task's mailbox, see Task_Create_Mailbox()
+ */
+typedef struct {
+    uint16_t data;
+    MTYPE    type;
+    PID      sender;
+} ASYNC_MSG;
+
 /**
  * This is the set of possible task priority levels
  */
@@ -98,18 +149,12 @@ typedef enum process_state {
     SEND_BLOCK,
     REPLY_BLOCK,
     RECV_BLOCK,
+    EVENT_BLOCK,
+    SEM_BLOCK,
+    SLEEP_BLOCK,
     NUM_PROCESS_STATES /* Must be last */
 } PROCESS_STATE;
 
-/**
- * This is the state of system clock overflow and is used to distinguish
- * whether a periodic tasks time of next start has overflowed and looped back around through 0.
- */
-typedef enum overflow_state {
-    EVEN = 0,
-    ODD = 1
-} OVERFLOW_STATE;
-
 /**
  * This is the set of kernel requests, i.e., a request code for each system call.
  */
@@ -125,6 +170,19 @@ typedef enum kernel_request_type {
     MSG_RECV,
     MSG_RPLY,
     MSG_ASEND,
+    ISR_ASEND,
+    MSG_DROPPED,
+    SCHEDULE_TABLE,
+    EVENT_CREATE,
+    EVENT_SET,
+    ISR_EVENT_SET,
+    EVENT_WAIT,
+    SEM_CREATE,
+    SEM_WAIT,
+    SEM_SIGNAL,
+    ISR_SEM_SIGNAL,
+    SLEEP,
+    SLEEP_UNTIL,
     TERMINATE,
     ABORT,
     NUM_KERNEL_REQUEST_TYPES /* Must be last */
@@ -146,9 +204,35 @@ typedef enum {
     QUEUEING_ERROR = 9,
     NULL_TASK_FUNCTION = 10,
     UART_ERROR = 11,
-    PWM_ERROR = 12
+    PWM_ERROR = 12,
+    MSG_OVERRUN = 13,
+    PERIODIC_WAIT = 14,
+    STACK_OVERFLOW = 15
 } ABORT_CODE;
 
+/**
+ * This is the set of reasons a periodic task may not be created by Task_Create_Period_Admit().
+ * ADMIT_UTILIZATION and ADMIT_CONFLICT are only given when ADMISSION_CONTROL is enabled.
+ */
+typedef enum {
+    ADMIT_OK = 0,
+    ADMIT_UTILIZATION,  /* The periodic tasks would need more than all of the CPU */
+    ADMIT_CONFLICT,     /* The task's execution windows overlap an admitted task's */
+    ADMIT_NO_ROOM       /* There is no free process descriptor, or no room for the stack */
+} ADMIT_CODE;
+
+/**
+ * A task's use of the CPU, in TIMER4 counts of 256 CPU cycles, see Task_Cpu_Stats()
+ */
+typedef struct {
+    uint32_t cpu;                        /* Counts the task has run for in total */
+    TICK     period;                     /* The period of a PERIODIC task, 0 otherwise */
+    uint16_t jobs;                       /* PERIODIC jobs finished */
+    uint16_t job_min;                    /* Counts of the shortest job */
+    uint16_t job_max;                    /* Counts of the longest job */
+    uint16_t job_hist[CPU_HIST_BINS];    /* Jobs by run time, bin i from i/CPU_HIST_BINS of the period */
+} CPU_STATS;
+
 /**
  * This struct is used to indirectly pass information within a kernel request
  */
@@ -167,6 +251,15 @@ typedef struct kernel_request_params_type {
     MTYPE                     msg_mask;
     PID                       msg_to;
     ABORT_CODE                abort_code;
+    ADMIT_CODE                out_admit;            /* Set by the kernel, why a periodic task wasn't created */
+    const uint8_t             *table;               /* PROGMEM slots of a schedule table, one per TICK of `period` */
+    void                      *buffer;              /* Caller owned memory passed to the kernel */
+    uint16_t                  length;               /* Number of elements in `buffer`, or bytes at `msg_ptr_data` */
+    uint8_t                   handle;               /* An EVENT or SEMAPHORE, set by the kernel when one is created */
+    uint16_t                  value;                /* Event flags to set or wait for, or a semaphore's initial count */
+    BOOL                      wait_all;             /* Wait for all of the event flags in `value`, instead of any */
+    TICK                      timeout;              /* TICKs to wait before giving up, 0 waits forever, or the TICK to sleep until */
+    uint16_t                  stack;                /* Bytes of stack for a new task, 0 for WORKSPACE */
 } KERNEL_REQUEST_PARAMS;
 
 #endif
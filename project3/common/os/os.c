@@ -57,7 +57,45 @@ PID Task_Create_RR(taskfuncptr f, int16_t arg) {
     return info.out_pid;
 }
 
+PID Task_Create_Mailbox(taskfuncptr f, int16_t arg, PRIORITY_LEVEL level, ASYNC_MSG* mailbox, uint8_t capacity, uint16_t stack) {
+
+    KERNEL_REQUEST_PARAMS info = {
+        .request = CREATE,
+        .priority = level,
+        .code = f,
+        .arg = arg,
+        .buffer = mailbox,
+        .length = capacity,
+        .stack = stack
+    };
+
+    Kernel_Request(&info);
+    return info.out_pid;
+}
+
+PID Task_Create_Stack(taskfuncptr f, int16_t arg, PRIORITY_LEVEL level, uint16_t stack) {
+
+    KERNEL_REQUEST_PARAMS info = {
+        .request = CREATE,
+        .priority = level,
+        .code = f,
+        .arg = arg,
+        .stack = stack
+    };
+
+    Kernel_Request(&info);
+    return info.out_pid;
+}
+
 PID Task_Create_Period(taskfuncptr f, int16_t arg, TICK period, TICK wcet, TICK offset) {
+    return Task_Create_Period_Admit(f, arg, period, wcet, offset, 0, NULL);
+}
+
+PID Task_Create_Period_Stack(taskfuncptr f, int16_t arg, TICK period, TICK wcet, TICK offset, uint16_t stack) {
+    return Task_Create_Period_Admit(f, arg, period, wcet, offset, stack, NULL);
+}
+
+PID Task_Create_Period_Admit(taskfuncptr f, int16_t arg, TICK period, TICK wcet, TICK offset, uint16_t stack, ADMIT_CODE* reason) {
     KERNEL_REQUEST_PARAMS info = {
         .request = CREATE,
         .priority = PERIODIC,
@@ -65,13 +103,28 @@ PID Task_Create_Period(taskfuncptr f, int16_t arg, TICK period, TICK wcet, TICK
         .arg = arg,
         .period = period,
         .wcet = wcet,
-        .offset = offset
+        .offset = offset,
+        .stack = stack
     };
 
     Kernel_Request(&info);
+
+    if (reason != NULL) {
+        *reason = info.out_admit;
+    }
     return info.out_pid;
 }
 
+void Task_Schedule_Table(const uint8_t* table, TICK length) {
+    KERNEL_REQUEST_PARAMS info = {
+        .request = SCHEDULE_TABLE,
+        .table = table,
+        .period = length
+    };
+
+    Kernel_Request(&info);
+}
+
 void Task_Next() {
     KERNEL_REQUEST_PARAMS info = {
         .request = NEXT
@@ -80,23 +133,108 @@ void Task_Next() {
     Kernel_Request(&info);
 }
 
+/*
+ * Read only queries don't enter the kernel, see Kernel_Read_Arg()
+ */
 int16_t Task_GetArg() {
+    return Kernel_Read_Arg();
+}
+
+PID Task_Pid() {
+    return Kernel_Read_Pid();
+}
+
+uint16_t Task_Stack_Peak(PID id, uint16_t* size) {
+    uint16_t stack_size;
+    uint16_t peak = Kernel_Read_Stack_Peak(id, &stack_size);
+
+    if (size != NULL) {
+        *size = stack_size;
+    }
+    return peak;
+}
+
+void Task_Stack_Report() {
+    PID id;
+    uint16_t peak, size;
+
+    UART_Init(0, LOGBAUD);
+    for (id = 0; id < MAXTHREAD; id += 1) {
+        peak = Task_Stack_Peak(id, &size);
+        if (size > 0) {
+            UART_print(0, "Stack %u: %u of %u bytes\n", id, peak, size);
+        }
+    }
+}
+
+BOOL Task_Cpu_Stats(PID id, CPU_STATS* stats) {
+    return Kernel_Read_Cpu_Stats(id, stats);
+}
+
+void Cpu_Totals(uint32_t* idle, uint32_t* kernel) {
+    Kernel_Read_Cpu_Totals(idle, kernel);
+}
+
+TICK Task_Wcet_Recommend(PID id) {
+    CPU_STATS stats;
+
+    if (!Task_Cpu_Stats(id, &stats) || stats.period == 0 || stats.jobs == 0) {
+        return 0;
+    }
+
+    // A job started at a TICK needs one more TICK of wcet than the TICKs it ran past
+    uint32_t counts = (uint32_t)stats.job_max * (100 + WCET_MARGIN) / 100;
+    return counts / TICK_COUNTS + 1;
+}
+
+void Task_Cpu_Report() {
+    CPU_STATS stats;
+    PID id;
+    uint8_t i;
+    uint32_t idle, kernel;
+
+    for (;;) {
+        Task_Sleep(Task_GetArg());
+
+        UART_Init(0, LOGBAUD);
+        for (id = 0; id < MAXTHREAD; id += 1) {
+            if (!Task_Cpu_Stats(id, &stats)) {
+                continue;
+            }
+
+            UART_print(0, "Cpu %u: %lu us\n", id, stats.cpu * COUNT_USEC);
+            if (stats.jobs > 0) {
+                UART_print(0, "  %u jobs, %lu to %lu us, wcet %u\n  ", stats.jobs,
+                    (uint32_t)stats.job_min * COUNT_USEC,
+                    (uint32_t)stats.job_max * COUNT_USEC, Task_Wcet_Recommend(id));
+                for (i = 0; i < CPU_HIST_BINS; i += 1) {
+                    UART_print(0, "%u ", stats.job_hist[i]);
+                }
+                UART_print(0, "\n");
+            }
+        }
+
+        Cpu_Totals(&idle, &kernel);
+        UART_print(0, "Idle %lu us, kernel %lu us\n", idle * COUNT_USEC, kernel * COUNT_USEC);
+    }
+}
+
+void Task_Sleep(TICK ticks) {
     KERNEL_REQUEST_PARAMS info = {
-        .request = GET_ARG
+        .request = SLEEP,
+        .timeout = ticks
     };
 
     Kernel_Request(&info);
-
-    return info.arg;
 }
 
-PID Task_Pid() {
+void Task_SleepUntil(TICK tick) {
     KERNEL_REQUEST_PARAMS info = {
-        .request = GET_PID
+        .request = SLEEP_UNTIL,
+        .timeout = tick
     };
 
     Kernel_Request(&info);
-    return info.out_pid;
 }
 
 /**
@@ -111,18 +249,39 @@ void Task_Terminate() {
 }
 
 void Msg_Send(PID id, MTYPE t, uint16_t* v) {
+    Msg_Send_Timeout(id, t, v, 0);
+}
+
+BOOL Msg_Send_Timeout(PID id, MTYPE t, uint16_t* v, TICK timeout) {
     KERNEL_REQUEST_PARAMS info = {
         .request = MSG_SEND,
         .msg_ptr_data = v,
+        .length = sizeof(*v),
+        .msg_mask = t,
+        .msg_to = id,
+        .timeout = timeout
+    };
+
+    Kernel_Request(&info);
+
+    // The reply was written into *v
+    return info.out_pid != TIMED_OUT;
+}
+
+uint16_t Msg_Send_Buf(PID id, MTYPE t, void* buf, uint16_t len) {
+    KERNEL_REQUEST_PARAMS info = {
+        .request = MSG_SEND,
+        .msg_ptr_data = buf,
+        .length = len,
         .msg_mask = t,
         .msg_to = id
     };
 
     Kernel_Request(&info);
-    *v = info.msg_data;
+    return info.length;
 }
 
-PID Msg_Recv(MASK m, uint16_t* v) {
+PID Msg_Recv_Buf(MASK m, void** buf, uint16_t* len) {
     KERNEL_REQUEST_PARAMS info = {
         .request = MSG_RECV,
         .msg_mask = m
@@ -130,7 +289,37 @@ PID Msg_Recv(MASK m, uint16_t* v) {
 
     Kernel_Request(&info);
 
-    if (info.msg_ptr_data != NULL) {
+    *buf = info.msg_ptr_data;
+    *len = info.length;
+    return info.out_pid;
+}
+
+void Msg_Rply_Buf(PID id, uint16_t len) {
+    KERNEL_REQUEST_PARAMS info = {
+        .request = MSG_RPLY,
+        .msg_to = id,
+        .length = len
+    };
+
+    Kernel_Request(&info);
+}
+
+PID Msg_Recv(MASK m, uint16_t* v) {
+    return Msg_Recv_Timeout(m, v, 0);
+}
+
+PID Msg_Recv_Timeout(MASK m, uint16_t* v, TICK timeout) {
+    KERNEL_REQUEST_PARAMS info = {
+        .request = MSG_RECV,
+        .msg_mask = m,
+        .timeout = timeout
+    };
+
+    Kernel_Request(&info);
+
+    if (info.out_pid == TIMED_OUT) {
+        // Nothing arrived, leave *v alone
+    } else if (info.msg_ptr_data != NULL) {
         // Data normal send
         *v = *info.msg_ptr_data;
     } else {
@@ -143,8 +332,9 @@ PID Msg_Recv(MASK m, uint16_t* v) {
 void Msg_Rply(PID id, uint16_t r) {
     KERNEL_REQUEST_PARAMS info = {
         .request = MSG_RPLY,
-        .msg_to = id,
-        .msg_data = r
+        .msg_ptr_data = &r,
+        .length = sizeof(r),
+        .msg_to = id
     };
 
     Kernel_Request(&info);
@@ -161,11 +351,113 @@ void Msg_ASend(PID id, MTYPE t, uint16_t v) {
     Kernel_Request(&info);
 }
 
-TICK Now() {
+void Msg_ASend_ISR(PID id, MTYPE t, uint16_t v) {
     KERNEL_REQUEST_PARAMS info = {
-        .request = GET_NOW
+        .request = ISR_ASEND,
+        .msg_data = v,
+        .msg_mask = t,
+        .msg_to = id
+    };
+
+    Kernel_Request_From_ISR(&info);
+}
+
+uint16_t Msg_Dropped(PID id) {
+    KERNEL_REQUEST_PARAMS info = {
+        .request = MSG_DROPPED,
+        .msg_to = id
+    };
+
+    Kernel_Request(&info);
+    return info.msg_data;
+}
+
+EVENT Event_Create() {
+    KERNEL_REQUEST_PARAMS info = {
+        .request = EVENT_CREATE
+    };
+
+    Kernel_Request(&info);
+    return info.handle;
+}
+
+void Event_Set(EVENT e, uint8_t flags) {
+    KERNEL_REQUEST_PARAMS info = {
+        .request = EVENT_SET,
+        .handle = e,
+        .value = flags
     };
 
     Kernel_Request(&info);
-    return info.out_now;
+}
+
+void Event_Set_ISR(EVENT e, uint8_t flags) {
+    KERNEL_REQUEST_PARAMS info = {
+        .request = ISR_EVENT_SET,
+        .handle = e,
+        .value = flags
+    };
+
+    Kernel_Request_From_ISR(&info);
+}
+
+uint8_t Event_Wait(EVENT e, uint8_t flags, BOOL all) {
+    KERNEL_REQUEST_PARAMS info = {
+        .request = EVENT_WAIT,
+        .handle = e,
+        .value = flags,
+        .wait_all = all
+    };
+
+    Kernel_Request(&info);
+    return info.value;
+}
+
+SEMAPHORE Sem_Create(uint16_t count) {
+    KERNEL_REQUEST_PARAMS info = {
+        .request = SEM_CREATE,
+        .value = count
+    };
+
+    Kernel_Request(&info);
+    return info.handle;
+}
+
+void Sem_Wait(SEMAPHORE s) {
+    KERNEL_REQUEST_PARAMS info = {
+        .request = SEM_WAIT,
+        .handle = s
+    };
+
+    Kernel_Request(&info);
+}
+
+void Sem_Signal(SEMAPHORE s) {
+    KERNEL_REQUEST_PARAMS info = {
+        .request = SEM_SIGNAL,
+        .handle = s
+    };
+
+    Kernel_Request(&info);
+}
+
+void Sem_Signal_ISR(SEMAPHORE s) {
+    KERNEL_REQUEST_PARAMS info = {
+        .request = ISR_SEM_SIGNAL,
+        .handle = s
+    };
+
+    Kernel_Request_From_ISR(&info);
+}
+
+TICK Now() {
+    return Kernel_Read_Now();
+}
+
+uint32_t Now32() {
+    return Kernel_Read_Now32();
+}
+
+uint32_t Now_us() {
+    return Kernel_Read_Now_us();
 }
@@ -33,6 +33,11 @@ void OS_Abort(ABORT_CODE error);
  * pre-empted. If they are preempted, then reenter at the front of their level. If they
  * expire their quantum, then they go back to the end of their level. Currently, a quantum
  * is defined to be 1 TICK.
+ *
+ * With PERIODIC_POLICY set to POLICY_RM or POLICY_EDF, Periodic tasks may overlap.
+ * A released Periodic job preempts the running one if its period is shorter (RM),
+ * or its deadline, the start of its next period, is earlier (EDF). A job may run past
+ * its wcet, the RTOS only aborts when a job is still unfinished at its deadline.
  */
 
 /**
@@ -42,13 +47,55 @@ void OS_Abort(ABORT_CODE error);
  *  - `period`: the task's execution period in multiples of TICKs
  *  - `wcet`:   the task's worst-case execution time in TICKs, must be less than "period"
  *  - `offset`  the task's start time in TICKs
- * Returns 0 if not successful; otherwise a non-zero PID.
+ * Returns NO_PID if not successful; otherwise the task's PID, which may be 0.
+ * Every Task_Create function below returns the same way.
  * NOTE: If a /task function/ executes a return, it terminates automatically!
  */
 PID Task_Create_System(taskfuncptr f, int16_t arg);
 PID Task_Create_RR(taskfuncptr f, int16_t arg);
 PID Task_Create_Period(taskfuncptr f, int16_t arg, TICK period, TICK wcet, TICK offset);
 
+/**
+ * Creates a SYSTEM or RR task (`level`) with a mailbox of `capacity` messages in `mailbox`,
+ * which must stay valid for the life of the task. Msg_ASend() messages that arrive
+ * while the task isn't blocked on a matching Msg_Recv() wait in the mailbox,
+ * instead of being lost. A `stack` of 0 gives WORKSPACE bytes, see Task_Create_Stack().
+ */
+PID Task_Create_Mailbox(taskfuncptr f, int16_t arg, PRIORITY_LEVEL level, ASYNC_MSG* mailbox, uint8_t capacity, uint16_t stack);
+
+/**
+ * Creates a SYSTEM or RR task (`level`), or a PERIODIC one, with a stack of `stack` bytes,
+ * at least MIN_STACK. Functions without a `stack` give each task WORKSPACE bytes. Stacks
+ * share the STACK_ARENA bytes set aside for them. By default those fit MAXTHREAD default
+ * stacks; a station sets it to the sum of its own tasks' stacks. A terminated task's stack
+ * merges with free neighbours, so two small stacks freed side by side make room for a bigger one.
+ * Returns NO_PID if there isn't room for the stack.
+ */
+PID Task_Create_Stack(taskfuncptr f, int16_t arg, PRIORITY_LEVEL level, uint16_t stack);
+PID Task_Create_Period_Stack(taskfuncptr f, int16_t arg, TICK period, TICK wcet, TICK offset, uint16_t stack);
+
+/**
+ * With ADMISSION_CONTROL enabled, a periodic task is only created if it can be scheduled
+ * conflict-free alongside the periodic tasks that already exist. Its total utilization
+ * must fit, and its windows [start, start + wcet) must never overlap theirs.
+ * `reason` is the outcome: ADMIT_OK when the task was created, and the returned PID is
+ * its own, otherwise why it wasn't, and the returned PID is NO_PID. A `stack` of 0 gives
+ * WORKSPACE bytes.
+ */
+PID Task_Create_Period_Admit(taskfuncptr f, int16_t arg, TICK period, TICK wcet, TICK offset, uint16_t stack, ADMIT_CODE* reason);
+
+/**
+ * With PERIODIC_POLICY == POLICY_TABLE, Periodic tasks don't start in release order.
+ * They run in the slots of `table`, a PROGMEM array of `length` slots, one per TICK,
+ * that repeats forever. Each slot is SLOT_FREE, or the index of the task that owns it
+ * with SLOT_RELEASE set in the first slot of each job. A job that still runs when its
+ * slots end is a timing violation.
+ * The current TICK becomes slot 0, and the Periodic tasks created next, in the same
+ * TICK, get the indices 0, 1, 2, ... in order. Their offsets must agree with the table.
+ * See schedule.h to generate the table from a task set at compile time.
+ */
+void Task_Schedule_Table(const uint8_t* table, TICK length);
+
 /**
  * When a Periodic ask calls Task_Next(), it will resume at the beginning of its next period.
  * When a RR or System task calls Task_Next(), it voluntarily gives up execution and
@@ -56,6 +103,17 @@ PID Task_Create_Period(taskfuncptr f, int16_t arg, TICK period, TICK wcet, TICK
  */
 void Task_Next(void);
 
+/**
+ * A SYSTEM or RR task gives up the CPU until `ticks` TICKs from now, or until Now()
+ * reaches `tick`, which returns right away if it is already past. The current TICK
+ * has partly elapsed, so sleep one TICK more than a minimum delay needs.
+ * Unlike _delay_ms(), other tasks run meanwhile.
+ *
+ * Note: PERIODIC tasks are not allowed to sleep, they call Task_Next() instead.
+ */
+void Task_Sleep(TICK ticks);
+void Task_SleepUntil(TICK tick);
+
 /**
  * The calling task terminates itself.
  */
@@ -72,20 +130,81 @@ int16_t Task_GetArg(void);
  */
 PID Task_Pid(void);
 
+/**
+ * Stacks are filled with a pattern when their task is created. Task_Stack_Peak() returns
+ * the most bytes of its stack task "id" has used so far, and its stack size in `size`
+ * (when not NULL), or 0 if there is no such task. A task that runs into the bottom of
+ * its stack aborts the RTOS with STACK_OVERFLOW the next time it enters the kernel.
+ * Task_Stack_Report() prints the peak and size of every task's stack over UART 0.
+ */
+uint16_t Task_Stack_Peak(PID id, uint16_t* size);
+void Task_Stack_Report(void);
+
+/**
+ * With CPU_ACCOUNTING, the kernel reads TIMER4 each time it switches to or from a task,
+ * and charges the counts in between (256 CPU cycles each) to the task. PERIODIC tasks
+ * also keep the shortest and longest execution time of their jobs, the counts a job ran
+ * for before its Task_Next() not counting preemption, and a histogram of job execution
+ * times by fraction of the period. Interrupt handlers are charged to the task they
+ * interrupt. CPU_ACCOUNTING is off by default, it adds a CPU_STATS to every task and a
+ * TIMER4 read to every context switch.
+ * Task_Cpu_Stats() copies task "id"'s use into `stats`, and returns FALSE if there is no
+ * such task or CPU_ACCOUNTING is off. Cpu_Totals() returns the counts spent idle and in
+ * the kernel.
+ * Task_Wcet_Recommend() returns a wcet for PERIODIC task "id" that its longest job fits in
+ * with WCET_MARGIN percent to spare, or 0 if it hasn't finished a job.
+ * Task_Cpu_Report() is a task that prints all of this over UART 0 every "arg" TICKs,
+ * create it with Task_Create_RR().
+ */
+BOOL Task_Cpu_Stats(PID id, CPU_STATS* stats);
+void Cpu_Totals(uint32_t* idle, uint32_t* kernel);
+TICK Task_Wcet_Recommend(PID id);
+void Task_Cpu_Report(void);
+
 /**
  * Send-Recv-Rply is similar to QNX-style message-passing
- * Rply() to a NULL process is a no-op.
+ * Rply() to a NULL process is a no-op, as is a Rply() from any task but the one "id"
+ * sent to and is waiting on for its reply.
  * See: http://www.qnx.com/developers/docs/6.5.0/index.jsp?topic=%2Fcom.qnx.doc.neutrino_sys_arch%2Fipc.html
  *
+ * A task that another task is SEND_BLOCK or REPLY_BLOCK on inherits that task's priority
+ * until it replies, so a SYSTEM task sending to a RR server waits only for the server.
+ *
  * Note: PERIODIC tasks are not allowed to use Msg_Send() or Msg_Recv().
  */
 void Msg_Send(PID  id, MTYPE t, uint16_t* v);
 PID  Msg_Recv(MASK m,           uint16_t* v);
 void Msg_Rply(PID  id,          uint16_t r);
 
+/**
+ * Send-Recv with a timeout of "timeout" TICKs, 0 waits forever. Recv_Timeout()
+ * returns TIMED_OUT if no message arrived in time. Send_Timeout() returns FALSE if
+ * the message wasn't received in time, it then never is. Once received, the sender
+ * always waits for the reply.
+ * If the receiver terminates before replying, the send fails: Send_Timeout() returns
+ * FALSE, Send_Buf() returns 0, and Send() leaves "v" as it was.
+ */
+BOOL Msg_Send_Timeout(PID  id, MTYPE t, uint16_t* v, TICK timeout);
+PID  Msg_Recv_Timeout(MASK m,           uint16_t* v, TICK timeout);
+
+/**
+ * Send-Recv-Rply with a buffer of "len" bytes instead of a single word, nothing is copied.
+ * Recv_Buf() sets "buf" to the sender's own buffer, which the receiver may read, and
+ * write its reply into, until it calls Rply_Buf(). Rply_Buf() says how many bytes of the
+ * reply it wrote in place, which Send_Buf() returns. Only the task the sender is waiting
+ * on may reply, and a reply longer than the buffer aborts with MSG_OVERRUN.
+ * The two kinds mix: a Send() is a 2 byte buffer, and a Rply() is a 2 byte reply, which
+ * aborts with MSG_OVERRUN to a smaller buffer. A message from ASend() has no buffer,
+ * "buf" is NULL and "len" is 0, use Recv() for its value.
+ */
+uint16_t Msg_Send_Buf(PID  id, MTYPE t, void* buf, uint16_t len);
+PID      Msg_Recv_Buf(MASK m,           void** buf, uint16_t* len);
+void     Msg_Rply_Buf(PID  id,          uint16_t len);
+
 /**
  * Asynchronously Send a message "v" of type "t" to "id". The task "id" must be blocked on
- * Recv() state, otherwise it is a no-op. After passing "v" to "id", the returned PID of
+ * Recv() state, otherwise it is buffered in the mailbox of "id", or a no-op if it has no
+ * room. After passing "v" to "id", the returned PID of
  * Recv() is NULL (non-existent); thus, "id" doesn't need to reply to this message.
  * Note: The message type "t" must satisfy the MASK "m" imposed by "id". If not, then it
  * is a no-op.
@@ -94,6 +213,62 @@ void Msg_Rply(PID  id,          uint16_t r);
  */
 void Msg_ASend(PID id, MTYPE t, uint16_t v);
 
+/**
+ * Msg_ASend() for interrupt handlers, call it last in the handler. If "id" is waiting
+ * for "v" and has a higher priority than the interrupted task, "id" runs as soon as
+ * the handler returns, instead of at the next TICK. The interrupted task keeps its
+ * place, and the returned PID of Recv() is ISR_PID.
+ * A SYSTEM task blocked on Recv(), with a mailbox for bursts, makes a deferred
+ * handler for the interrupt's work.
+ */
+void Msg_ASend_ISR(PID id, MTYPE t, uint16_t v);
+
+/**
+ * A task created with Task_Create_Mailbox() buffers Msg_ASend() messages that arrive
+ * while it isn't blocked on Recv(). Recv() takes the first matching buffered message
+ * once no Send() is waiting, before it blocks. The returned PID is the sender's.
+ * Msg_Dropped() returns how many messages "id" lost because its mailbox was full.
+ * A task without a mailbox only gets messages it is blocked on, the rest aren't counted.
+ */
+uint16_t Msg_Dropped(PID id);
+
+/**
+ * Event groups hold 8 flags. Event_Set() sets "flags", and wakes every task whose
+ * Event_Wait() is now satisfied: by any of its "flags", or all of them when "all"
+ * is TRUE. Event_Wait() returns the flags that satisfied it, and clears them, so each
+ * Event_Set() is consumed once. If it isn't satisfied yet, the caller blocks.
+ * With WAIT_BY_PRIORITY, waiters are served highest priority first, otherwise first
+ * come first serve.
+ * Create() returns 0 when all MAXEVENT groups are in use.
+ *
+ * Event_Set_ISR() is Event_Set() for interrupt handlers, call it last in the handler,
+ * like Msg_ASend_ISR().
+ *
+ * Note: PERIODIC tasks may use Event_Set(), and interrupt handlers Event_Set_ISR(), but
+ * neither Event_Wait().
+ */
+EVENT   Event_Create (void);
+void    Event_Set    (EVENT e, uint8_t flags);
+void    Event_Set_ISR(EVENT e, uint8_t flags);
+uint8_t Event_Wait   (EVENT e, uint8_t flags, BOOL all);
+
+/**
+ * Counting semaphores, starting at "count". Sem_Wait() takes one unit, and blocks
+ * while there are none. Sem_Signal() gives one back, directly to the first waiting
+ * task if there is one. Waiters are ordered like Event_Wait(), and there is no
+ * priority inheritance. Create() returns 0 when all MAXSEM semaphores are in use.
+ *
+ * Sem_Signal_ISR() is Sem_Signal() for interrupt handlers, call it last in the handler,
+ * like Msg_ASend_ISR().
+ *
+ * Note: PERIODIC tasks may use Sem_Signal(), and interrupt handlers Sem_Signal_ISR(), but
+ * neither Sem_Wait().
+ */
+SEMAPHORE Sem_Create    (uint16_t count);
+void      Sem_Wait      (SEMAPHORE s);
+void      Sem_Signal    (SEMAPHORE s);
+void      Sem_Signal_ISR(SEMAPHORE s);
+
 /**
  * Returns the number of milliseconds since OS_Init(). Note that this number
  * wraps around after it overflows as an uint16_teger. The arithmetic
@@ -110,6 +285,16 @@ void Msg_ASend(PID id, MTYPE t, uint16_t v);
  */
 TICK Now();  // number of milliseconds since the RTOS boots.
 
+/**
+ * Now32() is the number of TICKs since the RTOS boots, 32 bits wide. It wraps around
+ * after about 16 months, so it can be stored and compared directly.
+ * Now_us() is the number of microseconds since the RTOS boots, to the resolution of a
+ * TIMER4 count (16 us). It wraps around every 71 minutes, so use it like Now(), by the
+ * difference of two readings.
+ */
+uint32_t Now32(void);
+uint32_t Now_us(void);
+
 
 /**
  * Booting:
@@ -0,0 +1,904 @@
+#include "os.h"
+#include "kernel.h"
+#include "../../timings/timings.h"
+#include "../../os/common.h"
+#include "../../Packet/Frame.h"
+#include "test_utils.h"
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <util/delay.h>
+
+/*
+ * Benchmarks time kernel operations with TIMER4, the system tick.
+ * One TCNT4 count is 256 CPU cycles (the prescaler), and a tick is OCR4A + 1 counts.
+ * Operations shorter than a count are timed in cycles with TIMER5 instead.
+ * Results are reported over UART 0 with LOG(), so build with DEBUG set to 1.
+ * Run the benchmarks on their own, they need most of the process descriptors.
+ * None of them has been run on the board or a simulator yet, so no results are
+ * recorded here, and the changes they time have no measured speed-up.
+ */
+#define BENCH_CYCLES_PER_COUNT 256
+#define BENCH_ITERATIONS       64
+
+static const MASK BENCH_RELEASE = 0x40;
+
+static uint16_t Bench_Counter() {
+    uint8_t old_sreg = SREG;
+    cli();
+    uint16_t count = TCNT4;
+    SREG = old_sreg;
+    return count;
+}
+
+// TIMER4 counts elapsed since `start`, allows for TCNT4 wrapping once at OCR4A
+static uint16_t Bench_Elapsed(uint16_t start) {
+    uint16_t now = Bench_Counter();
+    return now >= start ? now - start : now + (OCR4A + 1) - start;
+}
+
+// Converts the total counts of BENCH_ITERATIONS runs to cycles per run
+static uint32_t Bench_Cycles(uint32_t counts) {
+    return counts * BENCH_CYCLES_PER_COUNT / BENCH_ITERATIONS;
+}
+
+// Descriptors the benchmarks use without creating tasks, they never run so they need no stacks
+static PD bench_tasks[MAXTHREAD];
+
+// The Bench_Blocked_Task()s that have started, PID 0 is valid so they record themselves
+static PID bench_blocked[MAXTHREAD];
+static uint8_t bench_blocked_count;
+
+// Blocks until released by a BENCH_RELEASE message, then terminates
+void Bench_Blocked_Task() {
+    uint16_t x;
+
+    bench_blocked[bench_blocked_count] = Task_Pid();
+    bench_blocked_count += 1;
+
+    PID from = Msg_Recv(BENCH_RELEASE, &x);
+    Msg_Rply(from, 0);
+}
+
+/*
+ * The ready scan Dispatch() did before the ready bitmap. Blocked tasks stayed in
+ * their level's queue, and were moved from its head to its tail until a READY task
+ * came up, on every dispatch.
+ */
+static PD* Bench_Rotate_Ready(task_queue_t* queue) {
+    PD* first;
+    PD* iter_task;
+
+    first = iter_task = peek(queue);
+
+    do {
+        if (iter_task->state != READY) {
+            enqueue(queue, deque(queue));
+            iter_task = peek(queue);
+        } else {
+            break;
+        }
+    } while (iter_task != first);
+
+    return iter_task->state == READY ? iter_task : NULL;
+}
+
+/*
+ * Dispatch latency
+ * Times a Task_Next() round trip while `n` tasks exist in total, at least 2 since
+ * create() and this task already use two process descriptors. All the other tasks
+ * are SYSTEM tasks blocked on Msg_Recv(), so they should not be run.
+ * For comparison, the old ready scan is timed on a queue of as many blocked
+ * descriptors ahead of a READY one, which it added to every dispatch.
+ */
+void Bench_Dispatch(uint8_t n) {
+    task_queue_t queue;
+    uint8_t i, count;
+    uint16_t start, x = 0;
+    uint32_t total = 0, scan = 0;
+
+    bench_blocked_count = 0;
+    for (i = 2; i < n; i += 1) {
+        Task_Create_Stack(Bench_Blocked_Task, 0, SYSTEM, MIN_STACK);
+    }
+
+    // Let any that are queued behind this task start and block
+    Task_Next();
+    count = bench_blocked_count;
+
+    for (i = 0; i < BENCH_ITERATIONS; i += 1) {
+        start = Bench_Counter();
+        Task_Next();
+        total += Bench_Elapsed(start);
+    }
+
+    queue_init(&queue, SYSTEM);
+    for (i = 0; i <= count; i += 1) {
+        bench_tasks[i].priority = SYSTEM;
+        bench_tasks[i].state = i < count ? RECV_BLOCK : READY;
+        bench_tasks[i].next = NULL;
+        enqueue(&queue, &bench_tasks[i]);
+    }
+
+    for (i = 0; i < BENCH_ITERATIONS; i += 1) {
+        start = Bench_Counter();
+        Assert(Bench_Rotate_Ready(&queue) == &bench_tasks[count]);
+        scan += Bench_Elapsed(start);
+
+        // Put the READY descriptor back behind the blocked ones
+        enqueue(&queue, deque(&queue));
+    }
+
+    LOG("Dispatch, %u tasks: %lu cycles, the old ready scan added %lu cycles\n", 2 + count,
+        Bench_Cycles(total), Bench_Cycles(scan));
+
+    // Release the blocked tasks so they terminate
+    for (i = 0; i < count; i += 1) {
+        Msg_Send(bench_blocked[i], BENCH_RELEASE, &x);
+    }
+}
+
+/*
+ * Receive latency
+ * Times Msg_Recv() while every other process descriptor is a client blocked
+ * sending to this task. A filtered receive takes the message sent last.
+ */
+static const MASK BENCH_REQUEST = 0x01;
+static const MASK BENCH_LAST    = 0x02;
+
+// Sends one message to the arg, the last client created uses BENCH_LAST
+void Bench_Client() {
+    uint16_t x = 0;
+    Msg_Send(Task_GetArg() & 0xFF, Task_GetArg() >> 8, &x);
+}
+
+void Bench_Recv() {
+    PID pid = Task_Pid(), from;
+    uint8_t i, j, count = 0;
+    uint16_t start, x;
+    uint32_t any = 0, last = 0;
+
+    for (j = 0; j < BENCH_ITERATIONS; j += 1) {
+        // create() and this task already use two process descriptors
+        count = 0;
+        for (i = 2; i < MAXTHREAD; i += 1) {
+            MASK type = i + 1 < MAXTHREAD ? BENCH_REQUEST : BENCH_LAST;
+            if (Task_Create_Stack(Bench_Client, pid | (type << 8), SYSTEM, MIN_STACK) != NO_PID) {
+                count += 1;
+            }
+        }
+
+        // Let the clients block sending to us
+        Task_Next();
+
+        start = Bench_Counter();
+        from = Msg_Recv(BENCH_LAST, &x);
+        last += Bench_Elapsed(start);
+        Msg_Rply(from, 0);
+
+        start = Bench_Counter();
+        from = Msg_Recv(ANY, &x);
+        any += Bench_Elapsed(start);
+        Msg_Rply(from, 0);
+
+        // Release the rest of the clients so they terminate
+        for (i = 2; i < count; i += 1) {
+            Msg_Rply(Msg_Recv(ANY, &x), 0);
+        }
+    }
+
+    LOG("Recv, %u clients: any %lu cycles, last %lu cycles\n", count,
+        Bench_Cycles(any), Bench_Cycles(last));
+}
+
+/*
+ * Async throughput
+ * A periodic producer sends a burst of samples each TICK to a RR consumer that
+ * does some work per sample. Reports samples delivered per second and how many
+ * were dropped, without a mailbox and with one.
+ */
+#define BENCH_BURST    4
+#define BENCH_BURSTS   100
+#define BENCH_MAILBOX  8
+
+static const MASK BENCH_SAMPLE = 0x01;
+static const MASK BENCH_STOP   = 0x02;
+
+static volatile PID bench_consumer;
+static volatile PID bench_waiter;
+static ASYNC_MSG bench_mailbox[BENCH_MAILBOX];
+
+void Bench_Consumer() {
+    uint16_t x;
+    PID from;
+
+    for (;;) {
+        from = Msg_Recv(BENCH_SAMPLE | BENCH_STOP, &x);
+        if (x == 0xFFFF) {
+            Msg_Rply(from, 0);
+            return;
+        }
+
+        _delay_us(500);
+    }
+}
+
+void Bench_Producer() {
+    uint8_t i, j;
+
+    for (j = 0; j < BENCH_BURSTS; j += 1) {
+        for (i = 0; i < BENCH_BURST; i += 1) {
+            Msg_ASend(bench_consumer, BENCH_SAMPLE, i);
+        }
+        Task_Next();
+    }
+
+    Msg_ASend(bench_waiter, BENCH_RELEASE, 0);
+}
+
+void Bench_Async(uint8_t capacity) {
+    uint16_t x = 0xFFFF, dropped;
+    TICK start;
+
+    bench_waiter = Task_Pid();
+    bench_consumer = Task_Create_Mailbox(Bench_Consumer, 0, RR, bench_mailbox, capacity, 0);
+
+    start = Now();
+    Task_Create_Period(Bench_Producer, 0, 1, 0, 1);
+    Msg_Recv(BENCH_RELEASE, &x);
+
+    // Every sample that wasn't dropped is, or will be, received
+    dropped = Msg_Dropped(bench_consumer);
+    x = (uint32_t)(BENCH_BURST * BENCH_BURSTS - dropped) * 1000 / ((TICK)(Now() - start) * MSECPERTICK);
+
+    LOG("Async, mailbox %u: %u samples/s, %u of %u dropped\n", capacity,
+        x, dropped, BENCH_BURST * BENCH_BURSTS);
+
+    x = 0xFFFF;
+    Msg_Send(bench_consumer, BENCH_STOP, &x);
+}
+
+/*
+ * Message bandwidth
+ * Moves `size` bytes to a SYSTEM server and back, as one buffer message and
+ * as one single word message per 2 bytes. Reports bytes per second for each.
+ */
+static const MASK BENCH_DATA = 0x01;
+
+void Bench_Buf_Server() {
+    uint8_t* buf;
+    uint16_t len;
+    PID from;
+
+    for (;;) {
+        from = Msg_Recv_Buf(BENCH_DATA | BENCH_STOP, (void**)&buf, &len);
+        if (len == 0) {
+            Msg_Rply_Buf(from, 0);
+            return;
+        }
+
+        // Answer in place
+        buf[0] += 1;
+        Msg_Rply_Buf(from, len);
+    }
+}
+
+static uint32_t Bench_Bytes_Per_Second(uint16_t size, uint32_t counts) {
+    // At most 64 * F_CPU, which fits in 32 bits
+    return (uint32_t)size * F_CPU / Bench_Cycles(counts);
+}
+
+void Bench_Buf(uint16_t size) {
+    static uint8_t data[64];
+    uint16_t start, i, j;
+    uint32_t buf = 0, word = 0;
+    PID pid = Task_Create_System(Bench_Buf_Server, 0);
+
+    for (i = 0; i < BENCH_ITERATIONS; i += 1) {
+        start = Bench_Counter();
+        Msg_Send_Buf(pid, BENCH_DATA, data, size);
+        buf += Bench_Elapsed(start);
+
+        start = Bench_Counter();
+        for (j = 0; j < size; j += 2) {
+            Msg_Send(pid, BENCH_DATA, (uint16_t*)&data[j]);
+        }
+        word += Bench_Elapsed(start);
+    }
+
+    Msg_Send_Buf(pid, BENCH_STOP, NULL, 0);
+
+    LOG("Msg, %u bytes: buffer %lu B/s, word %lu B/s\n", size,
+        Bench_Bytes_Per_Second(size, buf), Bench_Bytes_Per_Second(size, word));
+}
+
+/*
+ * Periodic release jitter
+ * A periodic task records how far into its release TICK it started running.
+ * Every release must also see Now() advance by exactly one period.
+ * Build once with -DTICKLESS=0 (make TICKLESS=0) and once with the default of 1
+ * to compare the two modes.
+ */
+#define BENCH_JITTER_PERIOD   20
+#define BENCH_JITTER_RELEASES 16
+
+static volatile PID jitter_waiter;
+static volatile TICK jitter_last;
+static volatile uint8_t jitter_releases;
+static volatile uint16_t jitter_min;
+static volatile uint16_t jitter_max;
+
+static const uint8_t Bench_Jitter_Slots[BENCH_JITTER_PERIOD] PROGMEM = {
+    SLOT_FREE, SLOT_RELEASE | 0, SLOT_FREE, SLOT_FREE, SLOT_FREE,
+    SLOT_FREE, SLOT_FREE,        SLOT_FREE, SLOT_FREE, SLOT_FREE,
+    SLOT_FREE, SLOT_FREE,        SLOT_FREE, SLOT_FREE, SLOT_FREE,
+    SLOT_FREE, SLOT_FREE,        SLOT_FREE, SLOT_FREE, SLOT_FREE
+};
+
+void Bench_Jitter_Task() {
+    uint16_t count;
+    TICK now;
+
+    for (;;) {
+        count = Bench_Counter();
+        now = Now();
+
+        if (jitter_releases > 0) {
+            Assert((TICK)(now - jitter_last) == BENCH_JITTER_PERIOD);
+        }
+
+        jitter_last = now;
+        jitter_min = count < jitter_min ? count : jitter_min;
+        jitter_max = count > jitter_max ? count : jitter_max;
+        jitter_releases += 1;
+
+        if (jitter_releases == BENCH_JITTER_RELEASES) {
+            Msg_ASend(jitter_waiter, BENCH_RELEASE, 0);
+            return;
+        }
+
+        Task_Next();
+    }
+}
+
+void Bench_Release_Jitter() {
+    uint16_t x;
+
+    jitter_waiter = Task_Pid();
+    jitter_releases = 0;
+    jitter_min = 0xFFFF;
+    jitter_max = 0;
+
+    // Used with POLICY_TABLE, the same release every period
+    Task_Schedule_Table(Bench_Jitter_Slots, BENCH_JITTER_PERIOD);
+    Task_Create_Period(Bench_Jitter_Task, 0, BENCH_JITTER_PERIOD, 1, 1);
+
+    // Block so the CPU is idle between releases
+    Msg_Recv(BENCH_RELEASE, &x);
+
+    LOG("Release jitter (tickless %u): %lu to %lu cycles\n", TICKLESS,
+        (uint32_t)jitter_min * BENCH_CYCLES_PER_COUNT,
+        (uint32_t)jitter_max * BENCH_CYCLES_PER_COUNT);
+}
+
+/*
+ * Event wait vs polling
+ * A periodic producer hands a RR consumer an event every other TICK, while a
+ * RR background task counts as fast as it can. A polling consumer spins through
+ * its quantum, one blocked in Event_Wait() costs nothing until it is woken.
+ * Reports the background task's loops per second with each consumer.
+ */
+#define BENCH_EVENTS      50
+#define BENCH_EVENT_DATA  0x01
+#define BENCH_EVENT_STOP  0x02
+
+static EVENT bench_event;
+static volatile BOOL bench_polled;
+static volatile BOOL bench_stop;
+static volatile uint32_t bench_work;
+
+void Bench_Background() {
+    while (!bench_stop) {
+        bench_work += 1;
+    }
+}
+
+void Bench_Poll_Consumer() {
+    for (;;) {
+        while (!bench_polled && !bench_stop)
+            ;
+
+        if (bench_stop) {
+            return;
+        }
+
+        bench_polled = FALSE;
+    }
+}
+
+void Bench_Event_Consumer() {
+    while (!(Event_Wait(bench_event, BENCH_EVENT_DATA | BENCH_EVENT_STOP, FALSE) & BENCH_EVENT_STOP))
+        ;
+}
+
+void Bench_Event_Producer() {
+    uint8_t i;
+
+    for (i = 0; i < BENCH_EVENTS; i += 1) {
+        if (Task_GetArg()) {
+            Event_Set(bench_event, BENCH_EVENT_DATA);
+        } else {
+            bench_polled = TRUE;
+        }
+        Task_Next();
+    }
+
+    Msg_ASend(bench_waiter, BENCH_RELEASE, 0);
+}
+
+void Bench_Events(BOOL wait) {
+    uint16_t x;
+    uint32_t work;
+    TICK start;
+
+    bench_waiter = Task_Pid();
+    bench_stop = FALSE;
+    bench_polled = FALSE;
+    bench_work = 0;
+
+    if (bench_event == 0) {
+        bench_event = Event_Create();
+    }
+
+    Task_Create_RR(wait ? Bench_Event_Consumer : Bench_Poll_Consumer, 0);
+    Task_Create_RR(Bench_Background, 0);
+
+    start = Now();
+    Task_Create_Period(Bench_Event_Producer, wait, 2, 1, 1);
+    Msg_Recv(BENCH_RELEASE, &x);
+
+    work = bench_work * 1000 / ((TICK)(Now() - start) * MSECPERTICK);
+
+    // Stop the consumer and the background task, they terminate
+    bench_stop = TRUE;
+    if (wait) {
+        Event_Set(bench_event, BENCH_EVENT_STOP);
+    }
+
+    LOG("Events, %s consumer: %lu background loops/s\n", wait ? "waiting" : "polling", work);
+}
+
+/*
+ * Interrupt to task latency
+ * A RR task raises INT2 (PD2) in software, timestamped with Now_us(), and
+ * a SYSTEM handler timestamps when it gets to run. The interrupt either wakes the
+ * handler with Msg_ASend_ISR(), or sets a flag the handler polls every TICK.
+ */
+#define BENCH_IRQS 32
+
+static const MASK BENCH_IRQ = 0x01;
+
+static volatile BOOL bench_irq_wake;
+static volatile BOOL bench_irq_flag;
+static volatile BOOL bench_irq_done;
+static volatile PID bench_irq_handler;
+static volatile uint32_t bench_irq_start;
+static volatile uint32_t bench_irq_total;
+static volatile uint32_t bench_irq_max;
+
+ISR(INT2_vect) {
+    if (bench_irq_wake) {
+        Msg_ASend_ISR(bench_irq_handler, BENCH_IRQ, 0);
+    } else {
+        bench_irq_flag = TRUE;
+    }
+}
+
+void Bench_Irq_Handler() {
+    uint16_t x;
+    uint32_t latency;
+    uint8_t i;
+
+    for (i = 0; i < BENCH_IRQS; i += 1) {
+        if (bench_irq_wake) {
+            Msg_Recv(BENCH_IRQ, &x);
+        } else {
+            while (!bench_irq_flag) {
+                Task_Sleep(1);
+            }
+            bench_irq_flag = FALSE;
+        }
+
+        latency = Now_us() - bench_irq_start;
+        bench_irq_total += latency;
+        bench_irq_max = latency > bench_irq_max ? latency : bench_irq_max;
+        bench_irq_done = TRUE;
+    }
+}
+
+void Bench_Irq_Source() {
+    uint8_t i, j;
+
+    for (i = 0; i < BENCH_IRQS; i += 1) {
+        // Spread the interrupts over the TICK
+        for (j = 0; j < i % 8; j += 1) {
+            _delay_ms(1);
+        }
+
+        bench_irq_done = FALSE;
+        bench_irq_start = Now_us();
+
+        // A rising edge on an output pin still triggers INT2
+        BIT_SET(PORTD, 2);
+        BIT_CLR(PORTD, 2);
+
+        while (!bench_irq_done)
+            ;
+    }
+
+    Msg_ASend(bench_waiter, BENCH_RELEASE, 0);
+}
+
+void Bench_Irq(BOOL wake) {
+    uint16_t x;
+
+    bench_waiter = Task_Pid();
+    bench_irq_wake = wake;
+    bench_irq_flag = FALSE;
+    bench_irq_total = 0;
+    bench_irq_max = 0;
+
+    BIT_SET(DDRD, 2);
+    BIT_CLR(PORTD, 2);
+    EICRA |= _BV(ISC21) | _BV(ISC20);
+    EIFR = _BV(INTF2);
+    EIMSK |= _BV(INT2);
+
+    bench_irq_handler = Task_Create_System(Bench_Irq_Handler, 0);
+    Task_Create_RR(Bench_Irq_Source, 0);
+    Msg_Recv(BENCH_RELEASE, &x);
+
+    EIMSK &= ~_BV(INT2);
+
+    LOG("Interrupt latency, %s: mean %lu us, max %lu us\n", wake ? "Msg_ASend_ISR" : "polled",
+        bench_irq_total / BENCH_IRQS, bench_irq_max);
+}
+
+/*
+ * Interrupt latency while printing
+ * TIMER5 matches every 20 ms, longer than the longest UART_print(), and its handler
+ * records how far TCNT5 has counted past the match when it gets to run, which is
+ * how long interrupts were held off. It is sampled while this task prints over
+ * UART 0, and while it busy waits for as long.
+ */
+#define BENCH_PRINTS      16
+#define BENCH_PRINT_TICKS 24
+
+static volatile uint16_t bench_late_max;
+
+ISR(TIMER5_COMPA_vect) {
+    uint16_t late = TCNT5;
+
+    if (late > bench_late_max) {
+        bench_late_max = late;
+    }
+}
+
+// The most TIMER5 counts of 0.5 us its handler ran late by
+static uint16_t Bench_Late(BOOL print) {
+    TICK start;
+    uint8_t i;
+
+    bench_late_max = 0;
+
+    // CTC mode at F_CPU / 8
+    TCCR5A = 0;
+    TCNT5 = 0;
+    OCR5A = 39999;
+    TCCR5B = _BV(WGM52) | _BV(CS51);
+    TIFR5 = _BV(OCF5A);
+    TIMSK5 = _BV(OCIE5A);
+
+    if (print) {
+        UART_Init(0, LOGBAUD);
+        for (i = 0; i < BENCH_PRINTS; i += 1) {
+            UART_print(0, "%s\n", "Latency while printing over UART 0, 0123456789");
+        }
+    } else {
+        start = Now();
+        while ((TICK)(Now() - start) < BENCH_PRINT_TICKS)
+            ;
+    }
+
+    TIMSK5 = 0;
+    TCCR5B = 0;
+    return bench_late_max;
+}
+
+void Bench_Uart_Latency() {
+    uint16_t quiet = Bench_Late(FALSE);
+    uint16_t printing = Bench_Late(TRUE);
+
+    LOG("Interrupt latency, quiet: max %u us, printing: max %u us\n", quiet / 2, printing / 2);
+}
+
+/*
+ * UART RX throughput
+ * Needs TX1 (pin 18) wired to RX1 (pin 19). A counting sequence of bytes is queued
+ * on UART 1 as fast as the TX ring takes them, and read back in bulk with
+ * UART_Read() in the same loop. Bytes lost to a full RX ring show up as gaps.
+ */
+#define BENCH_RX_CHAN  1
+#define BENCH_RX_BYTES 2048
+
+void Bench_Uart_Rx(uint32_t baud) {
+    uint8_t buf[16];
+    uint8_t i, n, expect = 0;
+    uint16_t sent = 0, received = 0, gaps = 0;
+    uint32_t start, elapsed;
+    TICK drained;
+
+    UART_Init(BENCH_RX_CHAN, baud);
+    UART_Flush(BENCH_RX_CHAN);
+
+    start = Now_us();
+    drained = 0;
+    while (sent < BENCH_RX_BYTES || !UART_Writable(BENCH_RX_CHAN) || (TICK)(Now() - drained) < 2) {
+        if (sent < BENCH_RX_BYTES) {
+            if (UART_Queue(BENCH_RX_CHAN, (uint8_t)sent)) {
+                sent += 1;
+            }
+        } else if (drained == 0 && UART_Writable(BENCH_RX_CHAN)) {
+            // Everything is out, give the last bytes 2 TICKs to arrive
+            drained = Now();
+        }
+
+        n = UART_Read(BENCH_RX_CHAN, buf, sizeof(buf));
+        for (i = 0; i < n; i += 1) {
+            gaps += buf[i] != expect;
+            expect = buf[i] + 1;
+        }
+        received += n;
+    }
+    elapsed = Now_us() - start;
+
+    if (received == 0) {
+        LOG("UART RX at %lu baud: nothing came back, wire TX1 to RX1\n", baud);
+        return;
+    }
+
+    LOG("UART RX at %lu baud: %lu bytes/s, %u of %u bytes lost in %u gaps\n", baud,
+        (uint32_t)received * 1000000 / elapsed, sent - received, sent, gaps);
+}
+
+/*
+ * Release heap throughput
+ * MAXTHREAD periodic tasks with the periods in timings.h are released over and
+ * over, each pop of the earliest release followed by a push of its next one.
+ */
+static task_heap_t bench_heap;
+
+void Bench_Heap() {
+    const TICK periods[] = {
+        UPDATE_PACKET_PERIOD, SEND_PACKET_PERIOD, UPDATE_LCD_PERIOD, MODE_PERIOD,
+        UPDATE_ARM_PERIOD, COMMAND_ROOMBA_PERIOD, ARM_TICK_PERIOD, LIGHT_SENSOR_PERIOD
+    };
+    uint8_t i;
+    uint16_t start;
+    uint32_t push = 0, cycle = 0;
+    PD* p;
+
+    heap_init(&bench_heap, HEAP_RELEASE);
+
+    for (i = 0; i < MAXTHREAD; i += 1) {
+        p = &bench_tasks[i];
+        p->priority = PERIODIC;
+        p->period = periods[i % (sizeof(periods) / sizeof(periods[0]))];
+        p->release = i;
+
+        start = Bench_Counter();
+        heap_push(&bench_heap, p);
+        push += Bench_Elapsed(start);
+    }
+
+    for (i = 0; i < BENCH_ITERATIONS; i += 1) {
+        start = Bench_Counter();
+        p = heap_pop(&bench_heap);
+        p->release += p->period;
+        heap_push(&bench_heap, p);
+        cycle += Bench_Elapsed(start);
+    }
+
+    LOG("Heap, %u tasks: push %lu cycles, pop and push %lu cycles\n", MAXTHREAD,
+        push * BENCH_CYCLES_PER_COUNT / MAXTHREAD, Bench_Cycles(cycle));
+}
+
+/*
+ * Switch latency
+ * Two SYSTEM tasks hand the CPU back and forth with Task_Next(), so each round
+ * trip is two voluntary context switches.
+ */
+static volatile BOOL bench_switching;
+
+void Bench_Switch_Partner() {
+    while (bench_switching) {
+        Task_Next();
+    }
+}
+
+void Bench_Switch() {
+    uint8_t i;
+    uint16_t start;
+    uint32_t total = 0;
+
+    bench_switching = TRUE;
+    Task_Create_System(Bench_Switch_Partner, 0);
+
+    for (i = 0; i < BENCH_ITERATIONS; i += 1) {
+        start = Bench_Counter();
+        Task_Next();
+        total += Bench_Elapsed(start);
+    }
+
+    LOG("Switch: %lu cycles\n", Bench_Cycles(total) / 2);
+
+    // Let the partner see the flag and terminate
+    bench_switching = FALSE;
+    Task_Next();
+}
+
+/*
+ * Read only queries
+ * Times Task_Pid(), Task_GetArg() and Now(), which read the kernel's state in
+ * place, against the same query made as a kernel request. A read is expected to
+ * take less than one TCNT4 count, so these are timed with TIMER5 running at
+ * F_CPU instead. The time to read TIMER5 twice is measured on its own and taken off.
+ */
+#define BENCH_TIME(total, expr)              \
+    {                                        \
+        uint8_t i_;                          \
+        uint16_t start_;                     \
+        for (i_ = 0; i_ < BENCH_ITERATIONS; i_ += 1) { \
+            start_ = Bench_Counter();        \
+            (expr);                          \
+            total += Bench_Elapsed(start_);  \
+        }                                    \
+    }
+
+// TCNT5 counts CPU cycles while the queries are timed
+static uint16_t Bench_Cycle_Counter() {
+    uint8_t old_sreg = SREG;
+    cli();
+    uint16_t count = TCNT5;
+    SREG = old_sreg;
+    return count;
+}
+
+// Like BENCH_TIME(), in cycles. TCNT5 wraps every 65536 cycles, a longer run would be misread
+#define BENCH_TIME_CYCLES(total, expr)       \
+    {                                        \
+        uint8_t i_;                          \
+        uint16_t start_;                     \
+        for (i_ = 0; i_ < BENCH_ITERATIONS; i_ += 1) { \
+            start_ = Bench_Cycle_Counter();  \
+            (expr);                          \
+            total += (uint16_t)(Bench_Cycle_Counter() - start_); \
+        }                                    \
+    }
+
+static volatile uint16_t bench_sink;
+
+static uint16_t Bench_Query(KERNEL_REQUEST_TYPE type) {
+    KERNEL_REQUEST_PARAMS info = {
+        .request = type
+    };
+
+    Kernel_Request(&info);
+    return type == GET_ARG ? info.arg : type == GET_PID ? info.out_pid : info.out_now;
+}
+
+static void Bench_Query_Log(const char* name, uint32_t request, uint32_t read, uint32_t none) {
+    LOG("%s: request %lu cycles, read %lu cycles\n", name,
+        (request > none ? request - none : 0) / BENCH_ITERATIONS,
+        (read > none ? read - none : 0) / BENCH_ITERATIONS);
+}
+
+void Bench_Queries() {
+    uint32_t none = 0, request, read;
+
+    // Normal mode at F_CPU, one count per cycle
+    TCCR5A = 0;
+    TCNT5 = 0;
+    TCCR5B = _BV(CS50);
+
+    BENCH_TIME_CYCLES(none, (void)0);
+
+    request = 0;
+    read = 0;
+    BENCH_TIME_CYCLES(request, bench_sink = Bench_Query(GET_PID));
+    BENCH_TIME_CYCLES(read, bench_sink = Task_Pid());
+    Bench_Query_Log("Task_Pid", request, read, none);
+
+    request = 0;
+    read = 0;
+    BENCH_TIME_CYCLES(request, bench_sink = Bench_Query(GET_ARG));
+    BENCH_TIME_CYCLES(read, bench_sink = Task_GetArg());
+    Bench_Query_Log("Task_GetArg", request, read, none);
+
+    request = 0;
+    read = 0;
+    BENCH_TIME_CYCLES(request, bench_sink = Bench_Query(GET_NOW));
+    BENCH_TIME_CYCLES(read, bench_sink = Now());
+    Bench_Query_Log("Now", request, read, none);
+
+    TCCR5B = 0;
+}
+
+/*
+ * Packet checksum
+ * Frame_Checksum() over a Packet's 12 checksummed bytes, against the Fletcher loop
+ * Packet used before, with 32 bit sums and a division at the end. The base used to
+ * run that loop once for each of the 6 fields it sets, now it runs once per packet.
+ */
+#define BENCH_PACKET_LEN 12
+
+static uint16_t Bench_Fletcher_32(const uint8_t* data, uint8_t len) {
+    uint32_t c0 = 0, c1 = 0;
+    uint8_t i;
+
+    for (i = 0; i < len; i += 1) {
+        c0 = c0 + data[i];
+        c1 = c1 + c0;
+    }
+
+    return ((c1 % 255) << 8) | (c0 % 255);
+}
+
+void Bench_Checksum() {
+    uint8_t data[BENCH_PACKET_LEN] = {0xFE, 0xED, 0x01, 0xFF, 0x02, 0x00, 0x01, 0xFF, 0x02, 0x00, 0xFF, 0x00};
+    uint32_t none = 0, generic = 0, fast = 0;
+
+    Assert(Frame_Checksum(data, BENCH_PACKET_LEN) == Bench_Fletcher_32(data, BENCH_PACKET_LEN));
+
+    // A TCNT4 count is 256 cycles, too coarse for 12 bytes, so time it with TIMER5
+    // at F_CPU like the queries
+    TCCR5A = 0;
+    TCNT5 = 0;
+    TCCR5B = _BV(CS50);
+
+    BENCH_TIME_CYCLES(none, (void)0);
+    BENCH_TIME_CYCLES(generic, bench_sink = Bench_Fletcher_32(data, BENCH_PACKET_LEN));
+    BENCH_TIME_CYCLES(fast, bench_sink = Frame_Checksum(data, BENCH_PACKET_LEN));
+
+    TCCR5B = 0;
+
+    generic = (generic > none ? generic - none : 0) / BENCH_ITERATIONS;
+    fast = (fast > none ? fast - none : 0) / BENCH_ITERATIONS;
+
+    LOG("Checksum, %u bytes: 32 bit sums %lu cycles, folded %lu cycles\n", BENCH_PACKET_LEN, generic, fast);
+    LOG("Checksum per packet: %lu cycles before, %lu cycles now\n", 6 * generic, fast);
+}
+
+void Bench_Test() {
+    Bench_Dispatch(2);
+    Bench_Dispatch(8);
+    Bench_Dispatch(MAXTHREAD);
+    Bench_Switch();
+    Bench_Heap();
+    Bench_Recv();
+    Bench_Async(0);
+    Bench_Async(BENCH_MAILBOX);
+    Bench_Buf(2);
+    Bench_Buf(14);
+    Bench_Buf(64);
+    Bench_Release_Jitter();
+    Bench_Events(FALSE);
+    Bench_Events(TRUE);
+    Bench_Irq(FALSE);
+    Bench_Irq(TRUE);
+    Bench_Uart_Latency();
+    Bench_Uart_Rx(57600);
+    Bench_Uart_Rx(115200);
+    Bench_Queries();
+    Bench_Checksum();
+}
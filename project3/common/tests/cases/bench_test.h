@@ -0,0 +1,6 @@
+#ifndef _BENCH_TEST_H_
+#define  _BENCH_TEST_H_
+
+#include "bench_test.c"
+
+#endif
@@ -0,0 +1,110 @@
+#include "../../os/common.h"
+#include "../../Packet/Frame.h"
+#include "test_utils.h"
+#include <string.h>
+
+#define FRAME_TEST_LEN 8
+
+FRAME_PARSER frame_test_parser;
+uint8_t frame_test_payload[FRAME_TEST_LEN] = {0x12, 0x00, 0x34, 0x00, 0x00, 0x56};
+uint8_t frame_test_encoded[FRAME_SIZE(FRAME_TEST_LEN)];
+uint8_t frame_test_size;
+
+/*
+ * Feeds "len" bytes, and returns the result of the last one
+ */
+FRAME_RESULT Frame_Test_Feed(const uint8_t* bytes, uint8_t len) {
+    FRAME_RESULT result = FRAME_PENDING;
+    uint8_t i;
+
+    for (i = 0; i < len; i += 1) {
+        result = Frame_Feed(&frame_test_parser, bytes[i]);
+    }
+
+    return result;
+}
+
+/////////////////////////////////////////////////////
+// A frame has no 0x00 but its delimiter, and decodes back to its payload
+/////////////////////////////////////////////////////
+void Frame_Round_Trip() {
+    uint8_t i;
+
+    for (i = 0; i + 1 < frame_test_size; i += 1) {
+        Assert(frame_test_encoded[i] != FRAME_DELIM);
+    }
+    Assert(frame_test_encoded[frame_test_size - 1] == FRAME_DELIM);
+
+    Assert(Frame_Test_Feed(frame_test_encoded, frame_test_size) == FRAME_GOOD);
+    Assert(memcmp(frame_test_parser.payload, frame_test_payload, FRAME_TEST_LEN) == 0);
+}
+
+/////////////////////////////////////////////////////
+// A frame split anywhere decodes the same, frames back to back each decode
+/////////////////////////////////////////////////////
+void Frame_Split() {
+    uint8_t split;
+
+    for (split = 1; split < frame_test_size; split += 1) {
+        Assert(Frame_Test_Feed(frame_test_encoded, split) == FRAME_PENDING);
+        Assert(Frame_Test_Feed(frame_test_encoded + split, frame_test_size - split) == FRAME_GOOD);
+    }
+
+    Assert(Frame_Test_Feed(frame_test_encoded, frame_test_size) == FRAME_GOOD);
+    Assert(Frame_Test_Feed(frame_test_encoded, frame_test_size) == FRAME_GOOD);
+}
+
+/////////////////////////////////////////////////////
+// Each kind of damage costs its own frame, and the next one decodes
+/////////////////////////////////////////////////////
+void Frame_Corrupt() {
+    uint8_t bytes[FRAME_SIZE(FRAME_TEST_LEN)];
+    uint8_t noise[FRAME_MAX + 8];
+
+    // Joined mid frame
+    Assert(Frame_Test_Feed(frame_test_encoded + 3, frame_test_size - 3) == FRAME_BAD_FRAMING);
+    Assert(Frame_Test_Feed(frame_test_encoded, frame_test_size) == FRAME_GOOD);
+
+    // A data byte changed, the length still fits
+    memcpy(bytes, frame_test_encoded, frame_test_size);
+    bytes[2] ^= 0x01;
+    Assert(Frame_Test_Feed(bytes, frame_test_size) == FRAME_BAD_CHECKSUM);
+    Assert(Frame_Test_Feed(frame_test_encoded, frame_test_size) == FRAME_GOOD);
+
+    // A code byte changed, the blocks no longer add up
+    memcpy(bytes, frame_test_encoded, frame_test_size);
+    bytes[0] += 1;
+    Assert(Frame_Test_Feed(bytes, frame_test_size) == FRAME_BAD_FRAMING);
+    Assert(Frame_Test_Feed(frame_test_encoded, frame_test_size) == FRAME_GOOD);
+
+    // A byte lost
+    memcpy(bytes, frame_test_encoded, 4);
+    memcpy(bytes + 4, frame_test_encoded + 5, frame_test_size - 5);
+    Assert(Frame_Test_Feed(bytes, frame_test_size - 1) == FRAME_BAD_FRAMING);
+    Assert(Frame_Test_Feed(frame_test_encoded, frame_test_size) == FRAME_GOOD);
+
+    // Noise longer than any frame
+    memset(noise, 0x5A, sizeof(noise));
+    Assert(Frame_Test_Feed(noise, sizeof(noise)) == FRAME_PENDING);
+    Assert(Frame_Feed(&frame_test_parser, FRAME_DELIM) == FRAME_BAD_FRAMING);
+    Assert(Frame_Test_Feed(frame_test_encoded, frame_test_size) == FRAME_GOOD);
+}
+
+void Frame_Test() {
+    uint16_t checksum = Frame_Checksum(frame_test_payload, FRAME_TEST_LEN - 2);
+    frame_test_payload[FRAME_TEST_LEN - 2] = HIGH_BYTE(checksum);
+    frame_test_payload[FRAME_TEST_LEN - 1] = LOW_BYTE(checksum);
+
+    frame_test_size = Frame_Encode(frame_test_payload, FRAME_TEST_LEN, frame_test_encoded);
+    Assert(frame_test_size == FRAME_SIZE(FRAME_TEST_LEN));
+
+    Frame_Init(&frame_test_parser, FRAME_TEST_LEN);
+    Frame_Round_Trip();
+    Frame_Split();
+    Frame_Corrupt();
+
+    // Every frame fed whole was good, each kind of damage cost one
+    Assert(frame_test_parser.good == 1 + (frame_test_size - 1) + 2 + 5);
+    Assert(frame_test_parser.framing_errors == 4);
+    Assert(frame_test_parser.checksum_errors == 1);
+}
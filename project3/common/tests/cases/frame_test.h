@@ -0,0 +1,6 @@
+#ifndef _FRAME_TEST_H_
+#define  _FRAME_TEST_H_
+
+#include "frame_test.c"
+
+#endif
@@ -121,6 +121,116 @@ void Msg_Async_Send() {
     Msg_ASend(pid, 0x08, Task_GetArg() + 4);
 }
 
+/*
+ * Async messages to a busy task wait in its mailbox, and the overflow is counted
+ */
+
+static ASYNC_MSG mailbox_test[2];
+
+void Msg_Mailbox_Recv() {
+    uint16_t x;
+
+    _delay_ms(100);
+    Assert(Msg_Dropped(Task_Pid()) == 1);
+
+    Msg_Recv(0x08, &x);
+    Assert(x == 1);
+    Msg_Recv(0x08, &x);
+    Assert(x == 2);
+
+    Msg_Send(Task_GetArg(), MSG_END, &x);
+}
+
+void Msg_Mailbox_Send() {
+    PID pid = Task_Create_Mailbox(Msg_Mailbox_Recv, Task_GetArg(), RR, mailbox_test, 2, 0);
+
+    Msg_ASend(pid, 0x08, 1);
+    Msg_ASend(pid, 0x08, 2);
+    Msg_ASend(pid, 0x08, 3);
+}
+
+/*
+ * A Recv() that skips older messages in the mailbox leaves them in order.
+ * Messages to a task without a mailbox, that isn't waiting, aren't counted as dropped.
+ */
+
+static ASYNC_MSG mailbox_order_test[3];
+
+void Msg_Mailbox_Order_Recv() {
+    uint16_t x;
+
+    _delay_ms(100);
+
+    Msg_Recv(0x10, &x);
+    Assert(x == 2);
+    Msg_Recv(0x08, &x);
+    Assert(x == 1);
+    Msg_Recv(0x08, &x);
+    Assert(x == 3);
+    Assert(Msg_Dropped(Task_Pid()) == 0);
+
+    Msg_Send(Task_GetArg(), MSG_END, &x);
+}
+
+void Msg_Mailbox_Order() {
+    uint16_t x;
+    PID pid = Task_Create_Mailbox(Msg_Mailbox_Order_Recv, Task_Pid(), RR, mailbox_order_test, 3, 0);
+
+    Msg_ASend(pid, 0x08, 1);
+    Msg_ASend(pid, 0x10, 2);
+    Msg_ASend(pid, 0x08, 3);
+
+    Msg_ASend(Task_Pid(), 0x08, 4);
+    Assert(Msg_Dropped(Task_Pid()) == 0);
+
+    PID from = Msg_Recv(MSG_END, &x);
+    Msg_Rply(from, 0);
+}
+
+/*
+ * Buffer messages are the sender's own memory, the reply is written in place
+ */
+
+void Msg_Buf_Recv() {
+    uint8_t* buf;
+    uint16_t len;
+    PID from = Msg_Recv_Buf(0x04, (void**)&buf, &len);
+
+    Assert(len == 14);
+    Assert(buf[0] == 'a' && buf[13] == 'n');
+
+    buf[0] = 'A';
+    buf[1] = 'B';
+    Msg_Rply_Buf(from, 2);
+
+    // A Send() is answered in place too
+    from = Msg_Recv_Buf(0x04, (void**)&buf, &len);
+    Assert(len == 2);
+    *(uint16_t*)buf += 1;
+    Msg_Rply_Buf(from, 2);
+
+    // A Rply() is a 2 byte reply written into the buffer
+    from = Msg_Recv_Buf(0x04, (void**)&buf, &len);
+    Msg_Rply(from, 0x4443);
+}
+
+void Msg_Buf_Send() {
+    uint8_t buf[14] = "abcdefghijklmn";
+    uint16_t x = 41;
+    PID pid = Task_Create_RR(Msg_Buf_Recv, 0);
+
+    Assert(Msg_Send_Buf(pid, 0x04, buf, sizeof(buf)) == 2);
+    Assert(buf[0] == 'A' && buf[1] == 'B' && buf[2] == 'c');
+
+    Msg_Send(pid, 0x04, &x);
+    Assert(x == 42);
+
+    Assert(Msg_Send_Buf(pid, 0x04, buf, sizeof(buf)) == 2);
+    Assert(*(uint16_t*)buf == 0x4443 && buf[2] == 'c');
+
+    Msg_Send(Task_GetArg(), MSG_END, &x);
+}
+
 /*
  * Stress test
  */
@@ -192,6 +302,56 @@ void Msg_Out_Order_Send_1() {
     Msg_Send(Task_GetArg(), MSG_END, &x);
 }
 
+/*
+ * A receive gives up when nothing arrives in time. A send gives up when it isn't
+ * received in time, and the message is taken back.
+ */
+void Msg_Timeout_Server() {
+    uint16_t x = 0;
+
+    // Sleep past the sender's timeout, its message must be gone
+    Task_Sleep(5);
+    Assert(Msg_Recv_Timeout(ANY, &x, 1) == TIMED_OUT);
+
+    Msg_ASend(Task_GetArg(), MSG_END, 0);
+}
+
+void Msg_Timeout() {
+    uint16_t x = 42;
+    TICK start = Now();
+
+    Assert(Msg_Recv_Timeout(0x40, &x, 3) == TIMED_OUT);
+    Assert((TICK)(Now() - start) >= 3 && (TICK)(Now() - start) <= 4);
+    Assert(x == 42);
+
+    PID pid = Task_Create_RR(Msg_Timeout_Server, Task_Pid());
+    Assert(Msg_Send_Timeout(pid, 0x01, &x, 2) == FALSE);
+    Assert(x == 42);
+
+    Msg_Recv(MSG_END, &x);
+}
+
+/*
+ * A receiver that terminates without replying fails the send
+ */
+
+void Msg_Term_Recv() {
+    uint16_t x;
+    Msg_Recv(0x40, &x);
+
+    // Terminates without replying
+}
+
+void Msg_Term_Send() {
+    uint16_t x = 7;
+    PID pid = Task_Create_RR(Msg_Term_Recv, 0);
+
+    Assert(!Msg_Send_Timeout(pid, 0x40, &x, 0));
+    Assert(x == 7);
+
+    Msg_Send(Task_GetArg(), MSG_END, &x);
+}
+
 void Msg_Test() {
     Task_Create_RR(Msg_Send_Never, 0);
     Task_Create_RR(Msg_Recv_Never, 0);
@@ -208,6 +368,9 @@ void Msg_Test() {
     Task_Create_RR(Msg_Async_Send, my_pid);
     Task_Create_RR(Msg_Stress_Send, my_pid);
     Task_Create_RR(Msg_Out_Order_Send_1, my_pid);
+    Task_Create_RR(Msg_Mailbox_Send, my_pid);
+    Task_Create_RR(Msg_Buf_Send, my_pid);
+    Task_Create_RR(Msg_Term_Send, my_pid);
 
     uint16_t x;
 
@@ -228,4 +391,16 @@ void Msg_Test() {
 
     from = Msg_Recv(MSG_END, &x);
     Msg_Rply(from, 0);
+
+    from = Msg_Recv(MSG_END, &x);
+    Msg_Rply(from, 0);
+
+    from = Msg_Recv(MSG_END, &x);
+    Msg_Rply(from, 0);
+
+    from = Msg_Recv(MSG_END, &x);
+    Msg_Rply(from, 0);
+
+    Msg_Timeout();
+    Msg_Mailbox_Order();
 }
@@ -226,6 +226,54 @@ void Msg_Mask_Send() {
     Assert(compare_trace(arr) == 1);
 }
 
+/*
+ * A RR server inherits the priority of a SYSTEM sender, so the send-to-reply time
+ * doesn't depend on how many RR tasks are ready. Without inheritance the server
+ * waits a TICK for each busy task in front of it.
+ */
+#define INHERIT_LOAD 4
+
+void Msg_Inherit_Busy() {
+    // Busy for several quanta, then let the test know we're done
+    _delay_ms(50);
+    Msg_ASend(Task_GetArg(), END, 0);
+}
+
+void Msg_Inherit_Server() {
+    uint16_t x;
+    PID from = Msg_Recv(RELEASE, &x);
+    add_to_trace('b');
+    Msg_Rply(from, x);
+}
+
+void Msg_Inherit_Latency() {
+    uint8_t i;
+    uint16_t x = 0;
+    TICK start;
+
+    clear_trace();
+    add_to_trace('s');
+
+    // The server is queued behind all of the busy tasks
+    for (i = 0; i < INHERIT_LOAD; i += 1) {
+        Task_Create_RR(Msg_Inherit_Busy, Task_Pid());
+    }
+    PID pid = Task_Create_RR(Msg_Inherit_Server, 0);
+
+    add_to_trace('a');
+    start = Now();
+    Msg_Send(pid, RELEASE, &x);
+    Assert((TICK)(Now() - start) <= 1);
+    add_to_trace('c');
+
+    for (i = 0; i < INHERIT_LOAD; i += 1) {
+        Msg_Recv(END, &x);
+    }
+
+    uint8_t arr[] = {'s', 'a', 'b', 'c'};
+    Assert(compare_trace(arr) == 1);
+}
+
 void Msg_Trace_Test() {
     clear_trace();
     Simple_Msg_Trace();
@@ -244,4 +292,7 @@ void Msg_Trace_Test() {
 
     clear_trace();
     Msg_Mask_Send();
+
+    clear_trace();
+    Msg_Inherit_Latency();
 }
@@ -17,6 +17,21 @@ void Now_Test() {
     Assert(n1 < n2);
 }
 
+void Now_Wide_Test() {
+    uint32_t t1 = Now32();
+    uint32_t u1 = Now_us();
+    _delay_ms(20);
+    uint32_t u2 = Now_us();
+    uint32_t t2 = Now32();
+
+    // The low 16 bits are Now()
+    Assert((TICK)t2 == Now() || (TICK)(t2 + 1) == Now());
+    Assert(t2 - t1 >= 1);
+
+    // _delay_ms() doesn't count time spent in the timer interrupt
+    Assert(u2 - u1 >= 20000 && u2 - u1 < 22000);
+}
+
 void Pid_Test() {
     // Hard to know what pid we are supposed to have
     // Just check that the pid is valid
@@ -27,6 +42,7 @@ void Pid_Test() {
 void OSFN_Test() {
     Task_Create_RR(Arg_Test, arg_val);
     Now_Test();
+    Now_Wide_Test();
     Pid_Test();
 
     // Wait for tasks to be run
@@ -131,6 +131,95 @@ void Task_Queue_remove_peek_test()
     AssertAborted();
 }
 
+/////////////////////////////////////////////////////
+// Release heap keeps the earliest release on top
+/////////////////////////////////////////////////////
+task_heap_t pr_test_heap;
+
+void Task_Heap_order_test()
+{
+    // Reuse the round robin tasks as periodic tasks
+    rr_test_task1.priority = PERIODIC;
+    rr_test_task2.priority = PERIODIC;
+    rr_test_task3.priority = PERIODIC;
+
+    Assert(heap_init(&pr_test_heap, HEAP_RELEASE) != NULL); // Initialized result is returned
+    Assert(pr_test_heap.length == 0);         // Heap is empty upon initialization
+    Assert(heap_peek(&pr_test_heap) == NULL); // Nothing on top of an empty heap
+
+    rr_test_task1.release = 30;
+    rr_test_task2.release = 10;
+    rr_test_task3.release = 20;
+    pr_test_task.release  = 65530; // Just before the clock overflows
+
+    heap_push(&pr_test_heap, &rr_test_task1);
+    Assert(heap_peek(&pr_test_heap) == &rr_test_task1); // Only task is on top
+    heap_push(&pr_test_heap, &rr_test_task2);
+    Assert(heap_peek(&pr_test_heap) == &rr_test_task2); // Earlier release moves to the top
+    heap_push(&pr_test_heap, &rr_test_task3);
+    Assert(heap_peek(&pr_test_heap) == &rr_test_task2); // Later release doesn't
+    heap_push(&pr_test_heap, &pr_test_task);
+    Assert(heap_peek(&pr_test_heap) == &pr_test_task);  // Release before the overflow goes first
+    Assert(pr_test_heap.length == 4);                   // Length reflects pushes
+
+    heap_push(&pr_test_heap, &sy_test_task);
+    AssertAborted();                                    // Only periodic tasks can be pushed
+    Assert(pr_test_heap.length == 4);                   // Heap remains unchanged
+
+    Assert(heap_pop(&pr_test_heap) == &pr_test_task);  // Tasks come out in release order
+    Assert(heap_pop(&pr_test_heap) == &rr_test_task2);
+    Assert(heap_pop(&pr_test_heap) == &rr_test_task3);
+    Assert(heap_pop(&pr_test_heap) == &rr_test_task1);
+    Assert(pr_test_heap.length == 0);                  // Nothing left
+
+    Assert(heap_pop(&pr_test_heap) == NULL); // Didn't get anything from popping an empty heap
+    AssertAborted();
+}
+
+/////////////////////////////////////////////////////
+// Removing from the middle and breaking ties
+/////////////////////////////////////////////////////
+void Task_Heap_remove_test()
+{
+    rr_test_task1.release = 5;
+    rr_test_task2.release = 7;
+    rr_test_task3.release = 9;
+
+    heap_push(&pr_test_heap, &rr_test_task1);
+    heap_push(&pr_test_heap, &rr_test_task2);
+    heap_push(&pr_test_heap, &rr_test_task3);
+
+    heap_remove(&pr_test_heap, &rr_test_task2);
+    Assert(pr_test_heap.length == 2);                   // Removed task is gone
+    Assert(heap_pop(&pr_test_heap) == &rr_test_task1);  // Order of the rest is kept
+    Assert(heap_pop(&pr_test_heap) == &rr_test_task3);
+
+    heap_remove(&pr_test_heap, &rr_test_task3);
+    AssertAborted();                                    // Can't remove a task that isn't there
+
+    // A task that has started this period goes after one that hasn't
+    rr_test_task1.wcet = rr_test_task2.wcet = 3;
+    rr_test_task1.ticks_remaining = 2;
+    rr_test_task2.ticks_remaining = 3;
+    rr_test_task1.release = rr_test_task2.release = 40;
+
+    heap_push(&pr_test_heap, &rr_test_task1);
+    heap_push(&pr_test_heap, &rr_test_task2);
+    Assert(heap_pop(&pr_test_heap) == &rr_test_task2);
+    Assert(heap_pop(&pr_test_heap) == &rr_test_task1);
+
+    // Even when the started one has more of its longer wcet left
+    rr_test_task1.wcet = 5;
+    rr_test_task1.ticks_remaining = 4;
+    rr_test_task2.wcet = 2;
+    rr_test_task2.ticks_remaining = 2;
+
+    heap_push(&pr_test_heap, &rr_test_task1);
+    heap_push(&pr_test_heap, &rr_test_task2);
+    Assert(heap_pop(&pr_test_heap) == &rr_test_task2);
+    Assert(heap_pop(&pr_test_heap) == &rr_test_task1);
+}
+
 void Task_Queue_Test()
 {
     ZeroMemory(rr_test_task1, sizeof(PD));
@@ -150,5 +239,7 @@ void Task_Queue_Test()
     Task_Queue_add_task_test();
     Task_Queue_add_multi_test();
     Task_Queue_remove_peek_test();
+    Task_Heap_order_test();
+    Task_Heap_remove_test();
 
 }
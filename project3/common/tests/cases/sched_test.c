@@ -0,0 +1,98 @@
+#include "os.h"
+#include "../../os/common.h"
+#include "trace.h"
+#include "test_utils.h"
+#include <avr/io.h>
+#include <util/delay.h>
+
+/*
+ * Task sets whose periodic jobs overlap, so they only run under POLICY_RM or
+ * POLICY_EDF. Each job busy waits for a little less than its execution time,
+ * adds its task's letter to the trace when it finishes, and the order of the
+ * trace is compared with the one worked out by hand for the policy.
+ * A deadline miss aborts the kernel, so only sets the policy can schedule are run.
+ */
+#define SCHED_DONE 0x01
+
+typedef struct {
+    TICK period;
+    TICK exec;      /* TICKs of CPU time each job uses */
+    uint8_t jobs;   /* Jobs to run before terminating */
+} SCHED_TASK;
+
+static SCHED_TASK sched_tasks[2];
+static PID sched_waiter;
+
+void Sched_Job() {
+    SCHED_TASK* t = &sched_tasks[Task_GetArg()];
+    uint8_t i;
+    uint16_t ms;
+
+    for (i = 0; i < t->jobs; i += 1) {
+        // _delay_ms() counts cycles, so time spent preempted doesn't count
+        for (ms = 2; ms < t->exec * MSECPERTICK; ms += 1) {
+            _delay_ms(1);
+        }
+        add_to_trace('a' + Task_GetArg());
+        Task_Next();
+    }
+
+    Msg_ASend(sched_waiter, SCHED_DONE, 0);
+}
+
+/*
+ * Runs two periodic tasks for one hyperperiod, both released 1 TICK after creation
+ */
+void Sched_Run(TICK p0, TICK c0, TICK p1, TICK c1, uint8_t hyperperiod, uint8_t expected[]) {
+    TICK now;
+    uint16_t x;
+
+    sched_waiter = Task_Pid();
+    sched_tasks[0] = (SCHED_TASK){ p0, c0, hyperperiod / p0 };
+    sched_tasks[1] = (SCHED_TASK){ p1, c1, hyperperiod / p1 };
+    clear_trace();
+
+    // Create both tasks in the same TICK so they are released together
+    now = Now();
+    while (Now() == now)
+        ;
+
+    Task_Create_Period(Sched_Job, 0, p0, c0, 1);
+    Task_Create_Period(Sched_Job, 1, p1, c1, 1);
+
+    Msg_Recv(SCHED_DONE, &x);
+    Msg_Recv(SCHED_DONE, &x);
+
+    Assert(compare_trace(expected) == 1);
+}
+
+/*
+ * Both policies schedule (4, 1) and (6, 4), utilization 11/12,
+ * but a's second job waits for b's deadline under EDF
+ */
+void Sched_Both() {
+    uint8_t rm[]  = {'a', 'a', 'b', 'a', 'b'};
+    uint8_t edf[] = {'a', 'b', 'a', 'a', 'b'};
+
+    Sched_Run(4, 1, 6, 4, 12, PERIODIC_POLICY == POLICY_RM ? rm : edf);
+}
+
+/*
+ * (4, 2) and (6, 3) use all of the CPU. Only EDF schedules it,
+ * under RM b's first job misses its deadline at 6.
+ */
+void Sched_Full_Utilization() {
+    uint8_t edf[] = {'a', 'b', 'a', 'a', 'b'};
+
+    Sched_Run(4, 2, 6, 3, 12, edf);
+}
+
+void Sched_Test() {
+    if (PERIODIC_POLICY == POLICY_RM || PERIODIC_POLICY == POLICY_EDF) {
+        Sched_Both();
+    }
+
+    if (PERIODIC_POLICY == POLICY_EDF) {
+        Sched_Full_Utilization();
+    }
+}
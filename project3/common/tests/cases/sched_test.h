@@ -0,0 +1,6 @@
+#ifndef _SCHED_TEST_H_
+#define  _SCHED_TEST_H_
+
+#include "sched_test.c"
+
+#endif
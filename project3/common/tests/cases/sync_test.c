@@ -0,0 +1,123 @@
+#include "os.h"
+#include "../../os/common.h"
+#include "trace.h"
+#include "test_utils.h"
+#include <avr/io.h>
+#include <util/delay.h>
+
+/*
+ * Semaphores count, a wait only blocks once the count runs out
+ */
+void Sync_Signaller() {
+    add_to_trace('g');
+    Sem_Signal(Task_GetArg());
+}
+
+void Sync_Sem_Count() {
+    SEMAPHORE s = Sem_Create(2);
+    Assert(s != 0);
+
+    clear_trace();
+    add_to_trace('s');
+
+    Sem_Wait(s);
+    Sem_Wait(s);
+    add_to_trace('a');
+
+    // Blocks until the RR task gets to run and signal
+    Task_Create_RR(Sync_Signaller, s);
+    Sem_Wait(s);
+    add_to_trace('b');
+
+    uint8_t arr[] = {'s', 'a', 'g', 'b'};
+    Assert(compare_trace(arr) == 1);
+}
+
+/*
+ * A RR task waits on a semaphore before a SYSTEM task does. With WAIT_BY_PRIORITY
+ * the first signal wakes the SYSTEM task, otherwise the RR task.
+ */
+static SEMAPHORE sync_sem;
+static SEMAPHORE sync_done;
+
+void Sync_Waiter() {
+    Sem_Wait(sync_sem);
+    add_to_trace(Task_GetArg());
+}
+
+void Sync_Order_Driver() {
+    Task_Create_RR(Sync_Waiter, 'r');
+    Task_Create_System(Sync_Waiter, 's');
+
+    Sem_Signal(sync_sem);
+    add_to_trace('a');
+    Sem_Signal(sync_sem);
+    add_to_trace('b');
+
+    Sem_Signal(sync_done);
+}
+
+void Sync_Sem_Order() {
+    sync_sem = Sem_Create(0);
+    sync_done = Sem_Create(0);
+    Assert(sync_sem != 0 && sync_done != 0);
+
+    clear_trace();
+
+    // Waking a task dispatches, so a woken RR task runs before the driver goes on
+    Task_Create_RR(Sync_Order_Driver, 0);
+    Sem_Wait(sync_done);
+
+    if (WAIT_BY_PRIORITY) {
+        uint8_t arr[] = {'s', 'a', 'r', 'b'};
+        Assert(compare_trace(arr) == 1);
+    } else {
+        uint8_t arr[] = {'r', 'a', 's', 'b'};
+        Assert(compare_trace(arr) == 1);
+    }
+}
+
+/*
+ * Waiting for all of the flags only wakes once every flag is set, waiting for any
+ * flag wakes on the first one. The flags that satisfied a wait are consumed.
+ */
+void Sync_Event_Waiter() {
+    EVENT e = Task_GetArg();
+
+    add_to_trace('w');
+    Assert(Event_Wait(e, 0x03, TRUE) == 0x03);
+    add_to_trace('c');
+    Assert(Event_Wait(e, 0x0C, FALSE) == 0x08);
+    add_to_trace('e');
+}
+
+void Sync_Event_Flags() {
+    EVENT e = Event_Create();
+    Assert(e != 0);
+
+    clear_trace();
+    add_to_trace('s');
+
+    Task_Create_System(Sync_Event_Waiter, e);
+
+    // Only one of the two flags, the waiter stays blocked
+    Event_Set(e, 0x01);
+    add_to_trace('a');
+
+    Event_Set(e, 0x02);
+    add_to_trace('b');
+
+    // 0x10 isn't waited for, so it is still set afterwards
+    Event_Set(e, 0x18);
+    add_to_trace('d');
+    Assert(Event_Wait(e, 0x10, FALSE) == 0x10);
+
+    uint8_t arr[] = {'s', 'w', 'a', 'c', 'b', 'e', 'd'};
+    Assert(compare_trace(arr) == 1);
+}
+
+void Sync_Test() {
+    Sync_Sem_Count();
+    Sync_Sem_Order();
+    Sync_Event_Flags();
+}
@@ -0,0 +1,6 @@
+#ifndef _SYNC_TEST_H_
+#define  _SYNC_TEST_H_
+
+#include "sync_test.c"
+
+#endif
@@ -3,6 +3,7 @@
 #include "trace.h"
 #include "test_utils.h"
 #include <avr/io.h>
+#include <avr/pgmspace.h>
 #include <util/delay.h>
 
 /*
@@ -27,6 +28,19 @@ void Task_Create_MaxThread() {
     _delay_ms(100 * (MAXTHREAD + 1));
 }
 
+/*
+ * The same with the smallest stacks, the MAXTHREAD limit is reached the same way
+ */
+void Task_Create_MaxThread_Min_Stack() {
+    int i;
+    for (i = 0; i < MAXTHREAD + 1; i += 1) {
+        Task_Create_Stack(Task_Limit_Test, i, RR, MIN_STACK);
+    }
+
+    // Wait for tasks to be run and die
+    _delay_ms(100 * (MAXTHREAD + 1));
+}
+
 /*
  * Creating a task with null function should OS abort
  */
@@ -55,8 +69,345 @@ void Task_Create_Priority() {
     Assert(compare_trace(arr) == 1);
 }
 
+/*
+ * With admission control, conflicting periodic tasks are refused with a reason
+ */
+void Task_Admitted() {
+    // Let the test know we started, then terminate
+    Msg_ASend(Task_GetArg(), 0x01, 0);
+}
+
+void Task_Create_Admission() {
+    ADMIT_CODE reason;
+    PID pid = Task_Pid();
+    uint16_t x;
+
+    // Starts at 100, 110, 120, ... for 2 ticks each
+    Task_Create_Period_Admit(Task_Admitted, pid, 10, 2, 100, 0, &reason);
+    Assert(reason == ADMIT_OK);
+
+    // Fits in the gap after the first task's windows
+    Task_Create_Period_Admit(Task_Admitted, pid, 10, 2, 105, 0, &reason);
+    Assert(reason == ADMIT_OK);
+
+    // Starts at 100 and 120 overlap the first task's windows
+    Assert(Task_Create_Period_Admit(Task_Admitted, 0, 20, 3, 100, 0, &reason) == NO_PID);
+    Assert(reason == ADMIT_CONFLICT);
+
+    // 2/10 + 2/10 + 3/4 of the CPU is more than it has
+    Assert(Task_Create_Period_Admit(Task_Admitted, 0, 4, 3, 103, 0, &reason) == NO_PID);
+    Assert(reason == ADMIT_UTILIZATION);
+
+    // Block until the admitted tasks have started, they terminate right away
+    Msg_Recv(0x01, &x);
+    Msg_Recv(0x01, &x);
+}
+
+/*
+ * Periodic jobs start at offset + k * period, whether they are released in
+ * order (POLICY_RELEASE) or from their slots in a schedule table (POLICY_TABLE)
+ */
+#define TABLE_JOBS 6
+
+static const uint8_t Task_Table_Slots[12] PROGMEM = {
+    SLOT_FREE, SLOT_RELEASE | 0, SLOT_RELEASE | 1, SLOT_FREE,
+    SLOT_FREE, SLOT_RELEASE | 0, SLOT_FREE,        SLOT_FREE,
+    SLOT_RELEASE | 1, SLOT_RELEASE | 0, SLOT_FREE, SLOT_FREE
+};
+
+static const TICK table_period[2] = { 4, 6 };
+static const TICK table_offset[2] = { 1, 2 };
+static TICK table_start;
+static PID table_waiter;
+
+void Task_Table_Job() {
+    int16_t i = Task_GetArg();
+    TICK k;
+
+    for (k = 0; k < TABLE_JOBS; k += 1) {
+        Assert((TICK)(Now() - table_start) == table_offset[i] + k * table_period[i]);
+        Task_Next();
+    }
+
+    Msg_ASend(table_waiter, 0x01, 0);
+}
+
+void Task_Schedule_Table_Release() {
+    uint16_t x;
+
+    table_waiter = Task_Pid();
+
+    // Install the table and create its tasks right after a TICK, in the same TICK
+    table_start = Now();
+    while (Now() == table_start)
+        ;
+    table_start = Now();
+
+    Task_Schedule_Table(Task_Table_Slots, 12);
+    Task_Create_Period(Task_Table_Job, 0, table_period[0], 0, table_offset[0]);
+    Task_Create_Period(Task_Table_Job, 1, table_period[1], 0, table_offset[1]);
+
+    Msg_Recv(0x01, &x);
+    Msg_Recv(0x01, &x);
+}
+
+/*
+ * A sleeping task lets lower priority tasks run, and wakes on time
+ */
+void Task_Sleep_Other() {
+    add_to_trace('b');
+}
+
+void Task_Sleep_Frees_CPU() {
+    TICK wake;
+
+    clear_trace();
+    add_to_trace('s');
+
+    // A busy wait here would run 'a' first
+    Task_Create_RR(Task_Sleep_Other, 0);
+    Task_Sleep(2);
+    add_to_trace('a');
+
+    wake = Now() + 3;
+    Task_SleepUntil(wake);
+    Assert(Now() == wake);
+
+    // Already past, returns right away
+    Task_SleepUntil(wake - 1);
+    Assert(Now() == wake);
+
+    uint8_t arr[] = {'s', 'b', 'a'};
+    Assert(compare_trace(arr) == 1);
+}
+
+/*
+ * Stacks are carved from a shared arena, and reused once their task terminates
+ */
+static volatile uint8_t stack_runs;
+
+void Task_Stack_Job() {
+    stack_runs += 1;
+}
+
+void Task_Stack_Arena() {
+    uint8_t i;
+
+    stack_runs = 0;
+
+    // Each task runs and terminates before the next is created,
+    // more stacks than the arena holds at once are handed out
+    for (i = 0; i < 3 * MAXTHREAD; i += 1) {
+        Assert(Task_Create_Stack(Task_Stack_Job, 0, SYSTEM, MIN_STACK) != NO_PID);
+    }
+    Assert(stack_runs == 3 * MAXTHREAD);
+
+    // Recoverable, the task just isn't created
+    Assert(Task_Create_Stack(Task_Stack_Job, 0, SYSTEM, STACK_ARENA) == NO_PID);
+    Assert(stack_runs == 3 * MAXTHREAD);
+
+    // Too small to be preempted
+    Task_Create_Stack(Task_Stack_Job, 0, SYSTEM, MIN_STACK - 1);
+    AssertAborted();
+}
+
+/*
+ * Free stacks that border each other are merged, so two MIN_STACK stacks freed next
+ * to each other in the middle of the arena make room for a WORKSPACE stack
+ */
+static PID stack_holders[MAXTHREAD];
+static uint8_t stack_holder_count;
+
+// Holds on to its stack until it is sent a message
+void Task_Stack_Holder() {
+    uint16_t x;
+    PID from = Msg_Recv(0x01, &x);
+    Msg_Rply(from, 0);
+}
+
+// Lets holder `i` terminate, and gives back its stack
+static void Task_Stack_Release(uint8_t i) {
+    uint16_t x = 0;
+
+    Msg_Send(stack_holders[i], 0x01, &x);
+    Task_Sleep(1);
+
+    stack_holder_count -= 1;
+    stack_holders[i] = stack_holders[stack_holder_count];
+}
+
+// Gives a new holder the largest stack there is room for, FALSE if not even MIN_STACK
+static BOOL Task_Stack_Hold_Largest() {
+    uint16_t size;
+    PID pid;
+
+    for (size = STACK_ARENA; size >= MIN_STACK && stack_holder_count < MAXTHREAD; size -= MIN_STACK / 2) {
+        pid = Task_Create_Stack(Task_Stack_Holder, 0, SYSTEM, size);
+        if (pid != NO_PID) {
+            stack_holders[stack_holder_count] = pid;
+            stack_holder_count += 1;
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+void Task_Stack_Merge() {
+    uint8_t i, largest = 0;
+    uint16_t size, largest_size = 0;
+    PID a, b;
+    uint16_t x = 0;
+
+    stack_holder_count = 0;
+    stack_runs = 0;
+
+    // Take up every free block, and the top of the arena
+    while (Task_Stack_Hold_Largest())
+        ;
+
+    // Free the largest, then take two MIN_STACK stacks from the bottom of it
+    for (i = 0; i < stack_holder_count; i += 1) {
+        Task_Stack_Peak(stack_holders[i], &size);
+        if (size > largest_size) {
+            largest = i;
+            largest_size = size;
+        }
+    }
+    Assert(largest_size >= 2 * MIN_STACK);
+    Task_Stack_Release(largest);
+
+    a = Task_Create_Stack(Task_Stack_Holder, 0, SYSTEM, MIN_STACK);
+    b = Task_Create_Stack(Task_Stack_Holder, 0, SYSTEM, MIN_STACK);
+    Assert(a != NO_PID && b != NO_PID);
+
+    // The rest of it goes to other holders, above them
+    while (Task_Stack_Hold_Largest())
+        ;
+    Assert(Task_Create_Stack(Task_Stack_Job, 0, SYSTEM, WORKSPACE) == NO_PID);
+
+    Msg_Send(a, 0x01, &x);
+    Msg_Send(b, 0x01, &x);
+    Task_Sleep(1);
+
+    // Only the two freed stacks together have room
+    Assert(Task_Create_Stack(Task_Stack_Job, 0, SYSTEM, WORKSPACE) != NO_PID);
+    Task_Sleep(1);
+    Assert(stack_runs == 1);
+
+    while (stack_holder_count > 0) {
+        Task_Stack_Release(stack_holder_count - 1);
+    }
+}
+
+/*
+ * A task's peak stack use covers what it put on its stack, even after it's popped
+ */
+void Task_Stack_User() {
+    volatile uint8_t local[64];
+    uint8_t i;
+    uint16_t x;
+
+    for (i = 0; i < sizeof(local); i += 1) {
+        local[i] = i;
+    }
+
+    PID from = Msg_Recv(0x01, &x);
+    Msg_Rply(from, 0);
+}
+
+void Task_Stack_Peak_Use() {
+    uint16_t peak, size, x = 0;
+    PID pid = Task_Create_System(Task_Stack_User, 0);
+
+    peak = Task_Stack_Peak(pid, &size);
+    Assert(size == WORKSPACE);
+    Assert(peak >= 64 && peak < size);
+
+    Msg_Send(pid, 0x01, &x);
+    Task_Next();
+
+    // Its stack went with it
+    Assert(Task_Stack_Peak(pid, &size) == 0 && size == 0);
+    Assert(Task_Stack_Peak(MAXTHREAD, NULL) == 0);
+}
+
+/*
+ * A periodic task's jobs are timed from release to Task_Next()
+ */
+static volatile BOOL cpu_job_stop;
+static PID cpu_waiter;
+
+void Task_Cpu_Job() {
+    uint8_t jobs = 0;
+
+    while (!cpu_job_stop) {
+        _delay_ms(MSECPERTICK / 2);
+
+        jobs += 1;
+        if (jobs == 4) {
+            Msg_ASend(cpu_waiter, 0x01, 0);
+        }
+        Task_Next();
+    }
+}
+
+void Task_Cpu_Accounting() {
+    CPU_STATS stats;
+    uint32_t idle, kernel, idle_after, kernel_after;
+    uint16_t x, jobs = 0;
+    uint8_t i;
+    PID pid;
+
+    cpu_waiter = Task_Pid();
+    cpu_job_stop = FALSE;
+    Cpu_Totals(&idle, &kernel);
+
+    pid = Task_Create_Period(Task_Cpu_Job, 0, 4, 2, 1);
+    Msg_Recv(0x01, &x);
+
+    Assert(Task_Cpu_Stats(pid, &stats));
+    Assert(stats.period == 4);
+    Assert(stats.jobs >= 3);
+
+    // Half a TICK is 312 counts of 16 us
+    Assert(stats.job_min > 280 && stats.job_max < 400);
+    Assert(stats.cpu >= (uint32_t)stats.jobs * stats.job_min);
+
+    for (i = 0; i < CPU_HIST_BINS; i += 1) {
+        jobs += stats.job_hist[i];
+    }
+    Assert(jobs == stats.jobs);
+
+    // Half a TICK, with the margin, finishes before the next TICK
+    Assert(Task_Wcet_Recommend(pid) == 1);
+
+    // The CPU was idle between jobs
+    Cpu_Totals(&idle_after, &kernel_after);
+    Assert(idle_after > idle && kernel_after > kernel);
+
+    cpu_job_stop = TRUE;
+    Task_Sleep(8);
+    Assert(!Task_Cpu_Stats(pid, &stats));
+}
+
 void Task_Test() {
     Task_Create_MaxThread();
+    Task_Create_MaxThread_Min_Stack();
     Task_Create_Null();
     Task_Create_Priority();
+    Task_Sleep_Frees_CPU();
+    Task_Stack_Arena();
+    Task_Stack_Merge();
+    Task_Stack_Peak_Use();
+
+    if (CPU_ACCOUNTING) {
+        Task_Cpu_Accounting();
+    }
+
+    Task_Schedule_Table_Release();
+
+    if (ADMISSION_CONTROL) {
+        Task_Create_Admission();
+    }
 }
@@ -2,10 +2,14 @@
 #define  _TEST_LIST_H_
 
 // Include all tests here
+#include "cases/bench_test.h"
+#include "cases/frame_test.h"
 #include "cases/msg_test.h"
 #include "cases/msg_trace_test.h"
 #include "cases/osfn_test.h"
 #include "cases/queue_test.h"
+#include "cases/sched_test.h"
+#include "cases/sync_test.h"
 #include "cases/task_test.h"
 
 #endif
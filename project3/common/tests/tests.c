@@ -50,6 +50,10 @@ void Test_Suite(TEST_MASKS mask) {
     Test_Case(mask, TEST_OSFN, "OSFN", OSFN_Test);
     Test_Case(mask, TEST_MSG_TRACE, "Msg Trace", Msg_Trace_Test);
     Test_Case(mask, TEST_TASKS, "Task", Task_Test);
+    Test_Case(mask, TEST_BENCH, "Bench", Bench_Test);
+    Test_Case(mask, TEST_SCHED, "Sched", Sched_Test);
+    Test_Case(mask, TEST_SYNC, "Sync", Sync_Test);
+    Test_Case(mask, TEST_FRAME, "Frame", Frame_Test);
 
     Check_PortE();
 
@@ -9,6 +9,7 @@
  *    eg  Test_Suite(TEST_THING)                        // To test one thing
  *    or  Test_Suite(TEST_THING | TEST_OTHER_THING)     // To test multiple things
  *    or  Test_Suite(TEST_ALL)                          // To run all tests
+ *    or  Test_Suite(TEST_BENCH)                        // The benches are opt-in, not in TEST_ALL
  */
 
 typedef enum {
@@ -17,7 +18,11 @@ typedef enum {
     TEST_OSFN           = 0x04,
     TEST_MSG_TRACE      = 0x08,
     TEST_TASKS          = 0x10,
-    TEST_ALL            = 0xFF // ie: TEST_THING | TEST_OTHER_THING | TEST_NEXT_THING ...
+    TEST_BENCH          = 0x20,
+    TEST_SCHED          = 0x40,
+    TEST_SYNC           = 0x80,
+    TEST_FRAME          = 0x100,
+    TEST_ALL            = 0x1DF // ie: TEST_THING | TEST_OTHER_THING | TEST_NEXT_THING ..., but not TEST_BENCH
 } TEST_MASKS;
 
 /**
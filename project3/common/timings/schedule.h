@@ -0,0 +1,271 @@
+#ifndef _SCHEDULE_H_
+#define _SCHEDULE_H_
+
+#include <stddef.h>
+#include <avr/pgmspace.h>
+
+extern "C" {
+    #include "os.h"
+    #include "common.h"
+    #include "timings.h"
+}
+
+/**
+ * Compile time description of a set of periodic tasks.
+ *
+ * Each job of a task owns the window [delay + k * period, delay + k * period + wcet).
+ * Describe a task set as a constexpr array of PeriodicTask, then static_assert
+ * that it is conflict free, so a bad edit to timings.h fails the build instead of
+ * aborting with a TIMING_VIOLATION on the board:
+ *
+ *     constexpr PeriodicTask tasks[] = {
+ *         { updatePacket, 0, UPDATE_PACKET_PERIOD, UPDATE_PACKET_WCET, UPDATE_PACKET_DELAY },
+ *         ...
+ *     };
+ *     static_assert(schedule::conflict_free(tasks), "...");
+ *
+ * and create the tasks with schedule::create(tasks).
+ *
+ * For PERIODIC_POLICY == POLICY_TABLE, SCHEDULE_TABLE(table, tasks) also
+ * generates the hyperperiod's slots in flash, create them with
+ * schedule::create(tasks, table).
+ */
+typedef struct {
+    taskfuncptr f;
+    int16_t     arg;
+    TICK        period;
+    TICK        wcet;
+    TICK        delay;
+} PeriodicTask;
+
+namespace schedule {
+
+constexpr uint32_t gcd(uint32_t a, uint32_t b) {
+    return b == 0 ? a : gcd(b, a % b);
+}
+
+constexpr uint32_t lcm(uint32_t a, uint32_t b) {
+    return a / gcd(a, b) * b;
+}
+
+// A job needs at least the tick it is released in
+constexpr uint32_t window(const PeriodicTask& t) {
+    return t.wcet > 0 ? t.wcet : 1;
+}
+
+// Difference of the delays of a and b, modulo m
+constexpr uint32_t phase(const PeriodicTask& a, const PeriodicTask& b, uint32_t m) {
+    return (((int32_t)b.delay - (int32_t)a.delay) % (int32_t)m + (int32_t)m) % m;
+}
+
+/**
+ * Windows of a and b only ever start phase + k * gcd(a.period, b.period) ticks apart.
+ * They never overlap iff the phase leaves room for a's window before b,
+ * and b's window before a's next.
+ */
+constexpr bool pair_conflict_free(const PeriodicTask& a, const PeriodicTask& b) {
+    return phase(a, b, gcd(a.period, b.period)) >= window(a) &&
+           phase(a, b, gcd(a.period, b.period)) + window(b) <= gcd(a.period, b.period);
+}
+
+// A task the kernel would accept, see Task_Create_Period()
+constexpr bool task_valid(const PeriodicTask& t) {
+    return t.f != NULL && t.period > 0 && t.wcet < t.period && t.period <= MAX_PERIOD && t.delay <= MAX_PERIOD;
+}
+
+template <size_t N>
+constexpr bool valid(const PeriodicTask (&tasks)[N], size_t i = 0) {
+    return i >= N || (task_valid(tasks[i]) && valid(tasks, i + 1));
+}
+
+/**
+ * True when no two jobs of any tasks in the set ever overlap
+ */
+template <size_t N>
+constexpr bool conflict_free(const PeriodicTask (&tasks)[N], size_t i = 0, size_t j = 1) {
+    return i >= N ? true
+         : j >= N ? conflict_free(tasks, i + 1, i + 2)
+         : pair_conflict_free(tasks[i], tasks[j]) && conflict_free(tasks, i, j + 1);
+}
+
+/**
+ * The schedule repeats every hyperperiod, the least common multiple of the periods
+ */
+template <size_t N>
+constexpr uint32_t hyperperiod(const PeriodicTask (&tasks)[N], size_t i = 0) {
+    return i >= N ? 1 : lcm(tasks[i].period, hyperperiod(tasks, i + 1));
+}
+
+// Tick of the hyperperiod relative to the start of each of t's jobs
+constexpr uint32_t since_release(const PeriodicTask& t, uint32_t tick) {
+    return (tick + t.period - t.delay % t.period) % t.period;
+}
+
+/**
+ * Schedule table slot for `tick` of the hyperperiod, see Task_Schedule_Table().
+ * Only meaningful for a conflict free set, where at most one window covers a tick.
+ */
+template <size_t N>
+constexpr uint8_t slot(const PeriodicTask (&tasks)[N], uint32_t tick, size_t i = 0) {
+    return i >= N ? SLOT_FREE
+         : since_release(tasks[i], tick) == 0 ? (uint8_t)(i | SLOT_RELEASE)
+         : since_release(tasks[i], tick) < window(tasks[i]) ? (uint8_t)i
+         : slot(tasks, tick, i + 1);
+}
+
+// Longest table SCHEDULE_TABLE() generates, one byte of flash per TICK
+#define SCHEDULE_MAX_TABLE 256
+
+template <size_t H>
+struct Table {
+    uint8_t slots[H];
+};
+
+template <size_t... I>
+struct indices {};
+
+template <size_t H, size_t... I>
+struct make_indices : make_indices<H - 1, H - 1, I...> {};
+
+template <size_t... I>
+struct make_indices<0, I...> {
+    typedef indices<I...> type;
+};
+
+template <size_t H, size_t N, size_t... I>
+constexpr Table<H> table(const PeriodicTask (&tasks)[N], indices<I...>) {
+    return Table<H>{ { slot(tasks, I)... } };
+}
+
+template <size_t H, size_t N>
+constexpr Table<H> table(const PeriodicTask (&tasks)[N]) {
+    return table<H>(tasks, typename make_indices<H>::type());
+}
+
+// Slots [r, r + window) of `t` are task i's job released at tick r
+template <size_t N, size_t H>
+constexpr bool job_matches(const PeriodicTask (&tasks)[N], const Table<H>& t, size_t i, uint32_t r, uint32_t j = 0) {
+    return j >= window(tasks[i]) ? true
+         : t.slots[(r + j) % H] == (j == 0 ? (uint8_t)(i | SLOT_RELEASE) : (uint8_t)i) &&
+           job_matches(tasks, t, i, r, j + 1);
+}
+
+// Every job of task i in the hyperperiod, released at delay + k * period like POLICY_RELEASE does
+template <size_t N, size_t H>
+constexpr bool jobs_match(const PeriodicTask (&tasks)[N], const Table<H>& t, size_t i, uint32_t k = 0) {
+    return k >= H / tasks[i].period ? true
+         : job_matches(tasks, t, i, tasks[i].delay + k * tasks[i].period) && jobs_match(tasks, t, i, k + 1);
+}
+
+template <size_t H>
+constexpr uint32_t busy_slots(const Table<H>& t, uint32_t s = 0) {
+    return s >= H ? 0 : (t.slots[s] != SLOT_FREE ? 1 : 0) + busy_slots(t, s + 1);
+}
+
+template <size_t N>
+constexpr uint32_t job_slots(const PeriodicTask (&tasks)[N], uint32_t h, size_t i = 0) {
+    return i >= N ? 0 : window(tasks[i]) * (h / tasks[i].period) + job_slots(tasks, h, i + 1);
+}
+
+/**
+ * True when `t` starts each task's jobs at the ticks it would be released at in order,
+ * owns the rest of their windows, and leaves every other slot free
+ */
+template <size_t N, size_t H>
+constexpr bool releases_match(const PeriodicTask (&tasks)[N], const Table<H>& t, size_t i = 0) {
+    return i >= N ? busy_slots(t) == job_slots(tasks, H)
+         : jobs_match(tasks, t, i) && releases_match(tasks, t, i + 1);
+}
+
+/**
+ * Defines `name`, the schedule table of the constexpr task set `tasks`, in flash
+ */
+#define SCHEDULE_TABLE(name, tasks)                                                 \
+    static_assert(schedule::conflict_free(tasks),                                   \
+                  "A schedule table needs conflict free tasks");                    \
+    static_assert(sizeof(tasks) / sizeof(tasks[0]) <= SLOT_TASK + 1,                \
+                  "Too many tasks for a schedule table");                           \
+    static_assert(schedule::hyperperiod(tasks) <= SCHEDULE_MAX_TABLE,               \
+                  "Hyperperiod too long for a schedule table");                     \
+    static_assert(schedule::releases_match(tasks,                                   \
+                      schedule::table<schedule::hyperperiod(tasks)>(tasks)),        \
+                  "Schedule table doesn't match the release times");                \
+    const schedule::Table<schedule::hyperperiod(tasks)> name PROGMEM =              \
+        schedule::table<schedule::hyperperiod(tasks)>(tasks)
+
+/**
+ * Creates every task in the set.
+ * Delays count from when each task is created, so the tasks are all created
+ * right after a TICK, before the next one, to keep the verified phases.
+ * The caller sleeps until that TICK, it must be a SYSTEM or RR task.
+ */
+template <size_t N>
+void create(const PeriodicTask (&tasks)[N]) {
+    size_t i;
+
+    Task_Sleep(1);
+
+    for (i = 0; i < N; i += 1) {
+        Task_Create_Period(tasks[i].f, tasks[i].arg, tasks[i].period, tasks[i].wcet, tasks[i].delay);
+    }
+}
+
+/**
+ * Installs the set's schedule table, then creates every task in the set in the
+ * same TICK, so slot 0 of the table is the TICK their delays count from.
+ * Without POLICY_TABLE the kernel ignores the table.
+ */
+template <size_t N, size_t H>
+void create(const PeriodicTask (&tasks)[N], const Table<H>& table) {
+    size_t i;
+
+    Task_Sleep(1);
+
+    Task_Schedule_Table(table.slots, H);
+
+    for (i = 0; i < N; i += 1) {
+        Task_Create_Period(tasks[i].f, tasks[i].arg, tasks[i].period, tasks[i].wcet, tasks[i].delay);
+    }
+}
+
+/*
+ * The generator's own test, the task set and table of Task_Schedule_Table_Release()
+ * in task_test.c, and a set with longer windows
+ */
+namespace test {
+
+inline void job() {}
+
+constexpr PeriodicTask release_tasks[] = {
+    { job, 0, 4, 0, 1 },
+    { job, 1, 6, 0, 2 }
+};
+
+constexpr Table<12> release_table = {{
+    SLOT_FREE, SLOT_RELEASE | 0, SLOT_RELEASE | 1, SLOT_FREE,
+    SLOT_FREE, SLOT_RELEASE | 0, SLOT_FREE,        SLOT_FREE,
+    SLOT_RELEASE | 1, SLOT_RELEASE | 0, SLOT_FREE, SLOT_FREE
+}};
+
+template <size_t H>
+constexpr bool same(const Table<H>& a, const Table<H>& b, uint32_t s = 0) {
+    return s >= H ? true : a.slots[s] == b.slots[s] && same(a, b, s + 1);
+}
+
+static_assert(conflict_free(release_tasks) && hyperperiod(release_tasks) == 12, "schedule.h test set");
+static_assert(same(table<12>(release_tasks), release_table), "schedule.h generates the wrong table");
+static_assert(releases_match(release_tasks, release_table), "schedule.h checks releases wrong");
+
+constexpr PeriodicTask window_tasks[] = {
+    { job, 0, 10, 3, 7 },
+    { job, 1, 5, 2, 0 }
+};
+
+static_assert(conflict_free(window_tasks), "schedule.h test set");
+static_assert(releases_match(window_tasks, table<10>(window_tasks)), "schedule.h generates the wrong table");
+
+}
+
+}
+
+#endif
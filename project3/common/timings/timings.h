@@ -19,16 +19,11 @@
 
 // Remote Station
 
-#define GET_DATA_PERIOD 4
-#define GET_DATA_WCET 3
-#define GET_DATA_DELAY 100
-
 #define UPDATE_ARM_PERIOD 2
 #define UPDATE_ARM_WCET 1
 #define UPDATE_ARM_DELAY 5
 
 #define COMMAND_ROOMBA_PERIOD 25
-#define COMMAND_ROOMBA_WCET 24
 #define COMMAND_ROOMBA_DELAY 20
 
 #define ARM_TICK_PERIOD 2
@@ -1,5 +1,6 @@
 #include <avr/io.h>
 #include <avr/interrupt.h>      // ISR handling.
+#include <util/atomic.h>        // ATOMIC_BLOCK
 #include <stdio.h>              // vsnprintf
 #include "../os/common.h"
 #include "../os/os.h"
@@ -11,10 +12,45 @@
  Global Variables:
  Variables appearing in both ISR/Main are defined as 'volatile'.
 */
-static volatile uint16_t _RXIn[4] = {0, 0, 0, 0};      // buffer 'element' counter.
-static volatile uint16_t _RXRn[4] = {0, 0, 0, 0};      // index of last read.
-static volatile bool     _RXWn[4] = {FALSE, FALSE, FALSE, FALSE}; // Ring buffer wrapped
-static volatile uint8_t  _RXBUFn[4][RX_BUFFER_SIZE]; // buffer of 'char'.
+
+/*
+ Received bytes wait in a ring per channel. The RX interrupt is the only writer
+ of _RXHn and the one task reading a channel is the only writer of _RXTn, both count
+ up, wrapping at 256. Their difference is the number of bytes in the ring, and
+ 8 bit reads and writes are atomic, so reading doesn't disable interrupts.
+*/
+#if ((RX_SIZE_0 - 1) & RX_SIZE_0) || ((RX_SIZE_1 - 1) & RX_SIZE_1) || \
+    ((RX_SIZE_2 - 1) & RX_SIZE_2) || ((RX_SIZE_3 - 1) & RX_SIZE_3) || \
+    RX_SIZE_0 > 128 || RX_SIZE_1 > 128 || RX_SIZE_2 > 128 || RX_SIZE_3 > 128
+#error "RX_SIZE_n must be a power of 2 up to 128"
+#endif
+
+static volatile uint8_t  _RXHn[4] = {0, 0, 0, 0};      // bytes received, the next is written at this index.
+static volatile uint8_t  _RXTn[4] = {0, 0, 0, 0};      // bytes read, the next is read at this index.
+static volatile uint8_t  _RXBUF0[RX_SIZE_0];
+static volatile uint8_t  _RXBUF1[RX_SIZE_1];
+static volatile uint8_t  _RXBUF2[RX_SIZE_2];
+static volatile uint8_t  _RXBUF3[RX_SIZE_3];
+static volatile uint8_t* const _RXBUFn[4] = {_RXBUF0, _RXBUF1, _RXBUF2, _RXBUF3};
+static const uint8_t     _RXSIZEn[4] = {RX_SIZE_0, RX_SIZE_1, RX_SIZE_2, RX_SIZE_3};
+
+/*
+ A task blocked in UART_Wait() on a channel, woken by the RX interrupt once
+ _RXWANTn bytes are waiting or _RXDELIMn arrives. _RXWANTn is 0 when none is.
+*/
+static volatile uint8_t  _RXWANTn[4] = {0, 0, 0, 0};
+static volatile int16_t  _RXDELIMn[4];
+static volatile PID      _RXPIDn[4];
+static volatile MTYPE    _RXTYPEn[4];
+
+/*
+ Bytes to transmit wait in a ring per channel, and the USARTn_UDRE interrupt
+ sends them one at a time while it is enabled. The ring is empty when
+ _TXHn == _TXTn, so it holds TX_RING_SIZE - 1 bytes.
+*/
+static volatile uint8_t  _TXHn[4] = {0, 0, 0, 0};      // index of the next byte to send.
+static volatile uint8_t  _TXTn[4] = {0, 0, 0, 0};      // index the next byte is queued at.
+static volatile uint8_t  _TXBUFn[4][TX_RING_SIZE];
 
 bool uart_initialized[4] = {FALSE, FALSE, FALSE, FALSE};
 
@@ -29,10 +65,38 @@ uint8_t TXENn[4]  = {TXEN0,  TXEN1,  TXEN2,  TXEN3};
 uint8_t RXENn[4]  = {RXEN0,  RXEN1,  RXEN2,  RXEN3};
 uint8_t RXCn[4]   = {RXC0,   RXC1,   RXC2,   RXC3};
 uint8_t UDREn[4]  = {UDRE0,  UDRE1,  UDRE2,  UDRE3};
+uint8_t UDRIEn[4] = {UDRIE0, UDRIE1, UDRIE2, UDRIE3};
 
 uint32_t current_bauds[4] = {0, 0, 0, 0};
 
 
+/*
+ Moves the oldest queued byte to the transmitter, which must be ready for it.
+ Called by the UDRE interrupt, with interrupts disabled.
+*/
+static void UART_Send_Next(uint8_t chan) {
+    uint8_t head = _TXHn[chan];
+
+    if (head == _TXTn[chan]) {
+        // Nothing left to send
+        *UCSRnB[chan] &= ~_BV(UDRIEn[chan]);
+        return;
+    }
+
+    *UDRn[chan] = _TXBUFn[chan][head];
+    _TXHn[chan] = (head + 1) & (TX_RING_SIZE - 1);
+}
+
+/*
+ Waits for the transmitter and sends the oldest queued byte, with interrupts disabled
+*/
+static void UART_Poll_Next(uint8_t chan) {
+    while (!((*UCSRnA[chan]) & _BV(UDREn[chan])))
+        ;
+    UART_Send_Next(chan);
+}
+
+
 void UART_Init(uint8_t chan, uint32_t baud_rate) {
     if (!CHAN_OK(chan)) {
         // Bad channel
@@ -57,104 +121,223 @@ void UART_Init(uint8_t chan, uint32_t baud_rate) {
 }
 
 
-void UART_Transmit(uint8_t chan, uint8_t byte) {
+/*
+ Queues a byte to be sent by the UDRE interrupt, without waiting.
+ Returns FALSE if the channel's ring is full.
+*/
+bool UART_Queue(uint8_t chan, uint8_t byte) {
     if (!CHAN_OK(chan) || !uart_initialized[chan]) {
         // Bad channel or not initialized
         OS_Abort(UART_ERROR);
-        return;
+        return FALSE;
     }
 
-    uint16_t old_sreg = SREG;
-    cli();
+    bool queued;
 
-    // Busy wait for empty transmit buffer
-    while (!((*UCSRnA[chan]) & _BV(UDREn[chan])))
-        ;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        uint8_t tail = _TXTn[chan];
+        uint8_t next = (tail + 1) & (TX_RING_SIZE - 1);
+        queued = next != _TXHn[chan];
+
+        if (queued) {
+            _TXBUFn[chan][tail] = byte;
+            _TXTn[chan] = next;
 
-    // Put data into buffer, sends the data
-    *UDRn[chan] = byte;
+            // The interrupt turns itself off once the ring is empty
+            *UCSRnB[chan] |= _BV(UDRIEn[chan]);
+        }
+    }
+
+    return queued;
+}
+
+/*
+ Queues a byte, waiting up to `timeout` TICKs for room, or forever if it is 0.
+ Interrupts stay enabled while it waits. It busy waits, so PERIODIC tasks may use it.
+ Returns FALSE if it timed out.
+*/
+bool UART_Transmit_Timeout(uint8_t chan, uint8_t byte, uint16_t timeout) {
+    if (!CHAN_OK(chan) || !uart_initialized[chan]) {
+        // Bad channel or not initialized
+        OS_Abort(UART_ERROR);
+        return FALSE;
+    }
+
+    TICK start = Now();
+
+    if (!(SREG & _BV(SREG_I))) {
+        // With interrupts disabled (LOG() in the kernel or an ISR) the UDRE interrupt
+        // can't run, so the ring is sent here by polling, like before
+        while (!UART_Queue(chan, byte)) {
+            UART_Poll_Next(chan);
+        }
+        while (_TXHn[chan] != _TXTn[chan]) {
+            UART_Poll_Next(chan);
+        }
+        return TRUE;
+    }
+
+    while (!UART_Queue(chan, byte)) {
+        if (timeout > 0 && (TICK)(Now() - start) >= timeout) {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
 
-    SREG = old_sreg;
+void UART_Transmit(uint8_t chan, uint8_t byte) {
+    UART_Transmit_Timeout(chan, byte, 0);
 }
 
 
 bool UART_Async_Receive(uint8_t chan, uint8_t* out) {
+    return UART_Read(chan, out, 1) == 1;
+}
+
+
+/*
+ Copies up to `n` of the bytes received on `chan` into `buf` without taking them.
+ Returns the number copied.
+*/
+uint8_t UART_Peek(uint8_t chan, uint8_t* buf, uint8_t n) {
     if (!CHAN_OK(chan) || !uart_initialized[chan]) {
         // Bad channel or not initialized
         OS_Abort(UART_ERROR);
-        return -1;
+        return 0;
     }
 
-    if (UART_Available(chan)) {
+    uint8_t tail = _RXTn[chan];
+    uint8_t count = _RXHn[chan] - tail;
+    uint8_t mask = _RXSIZEn[chan] - 1;
+    volatile uint8_t* ring = _RXBUFn[chan];
+    uint8_t i;
 
-        uint16_t old_sreg = SREG;
-        cli();
+    if (n > count) {
+        n = count;
+    }
 
-        // Return a byte from the buffer
-        *out = _RXBUFn[chan][_RXRn[chan]];
-
-        // Update the last byte read index
-        _RXRn[chan] = (_RXRn[chan] + 1) % RX_BUFFER_SIZE;
-
-        // Check for read index wrap / overflow
-        if (_RXRn[chan] == 0) {
-            if (_RXWn[chan]) {
-                _RXWn[chan] = FALSE;
-            } else {
-                // The read index is ahead of the write index.
-                // Evidence is that RXRn wrapped, but RXWn shows
-                // that RXIn hasn't wrapped
-                LOG("Out of bounds UART read\n");
-                OS_Abort(UART_ERROR);
-            }
-        }
+    for (i = 0; i < n; i += 1) {
+        buf[i] = ring[(uint8_t)(tail + i) & mask];
+    }
+
+    return n;
+}
 
-        SREG = old_sreg;
 
-        return TRUE;
-    } else {
+/*
+ Takes up to `n` of the bytes received on `chan` into `buf`.
+ Returns the number taken.
+*/
+uint8_t UART_Read(uint8_t chan, uint8_t* buf, uint8_t n) {
+    n = UART_Peek(chan, buf, n);
+
+    // The interrupt may now reuse their space
+    _RXTn[chan] += n;
+
+    return n;
+}
+
+
+/*
+ Looks for `delim` in the bytes received on `chan` from index `*from` on, and
+ moves `*from` past the ones it looked at.
+*/
+static bool UART_Scan(uint8_t chan, uint8_t* from, int16_t delim) {
+    uint8_t head = _RXHn[chan];
+    uint8_t mask = _RXSIZEn[chan] - 1;
+    volatile uint8_t* ring = _RXBUFn[chan];
+
+    if (delim == UART_NO_DELIM) {
         return FALSE;
     }
+
+    for (; *from != head; *from += 1) {
+        if (ring[*from & mask] == delim) {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
 }
 
 
-bool UART_Available(uint8_t chan) {
+uint8_t UART_Wait(uint8_t chan, uint8_t count, int16_t delim, uint8_t type, uint16_t timeout) {
     if (!CHAN_OK(chan) || !uart_initialized[chan]) {
         // Bad channel or not initialized
         OS_Abort(UART_ERROR);
-        return FALSE;
+        return 0;
     }
 
-    uint16_t old_sreg = SREG;
-    cli();
-    bool avail = _RXWn[chan] || _RXRn[chan] < _RXIn[chan];
-    SREG = old_sreg;
+    uint8_t seen = _RXTn[chan];
+    uint8_t sreg;
+    uint16_t v;
+    TICK start = Now();
+    TICK left = timeout;
+    bool found;
 
-    // Data has arrived since last read
-    return avail;
+    // More than the ring holds never arrives
+    if (count == 0 || count > _RXSIZEn[chan]) {
+        count = _RXSIZEn[chan];
+    }
+
+    for (;;) {
+        // Scan what is already here with interrupts on, then only what arrived since
+        found = UART_Scan(chan, &seen, delim);
+
+        sreg = SREG;
+        cli();
+        found = UART_Scan(chan, &seen, delim) || found;
+        if (found || (uint8_t)(_RXHn[chan] - _RXTn[chan]) >= count) {
+            SREG = sreg;
+            break;
+        }
+
+        _RXPIDn[chan] = Task_Pid();
+        _RXTYPEn[chan] = type;
+        _RXDELIMn[chan] = delim;
+        _RXWANTn[chan] = count;
+        SREG = sreg;
+
+        if (Msg_Recv_Timeout(type, &v, left) == TIMED_OUT) {
+            _RXWANTn[chan] = 0;
+            break;
+        }
+
+        // A wakeup left in the mailbox by an earlier timeout checks again
+        if (timeout != 0) {
+            if ((TICK)(Now() - start) >= timeout) {
+                _RXWANTn[chan] = 0;
+                break;
+            }
+            left = timeout - (TICK)(Now() - start);
+        }
+    }
+
+    return _RXHn[chan] - _RXTn[chan];
 }
 
 
-bool UART_BytesAvailable(uint8_t chan, uint16_t num) {
+bool UART_Available(uint8_t chan) {
     if (!CHAN_OK(chan) || !uart_initialized[chan]) {
         // Bad channel or not initialized
         OS_Abort(UART_ERROR);
         return FALSE;
     }
 
-    uint16_t old_sreg = SREG;
-    cli();
-    uint16_t last_read = _RXRn[chan];
-    uint16_t last_rxd  = _RXIn[chan];
-    bool     has_wrapped = _RXWn[chan];
+    // Data has arrived since last read
+    return _RXHn[chan] != _RXTn[chan];
+}
 
-    SREG = old_sreg;
 
-    if (!has_wrapped) {
-        return last_rxd - last_read >= num;
-    } else {
-        return RX_BUFFER_SIZE - last_read + last_rxd >= num;
+bool UART_BytesAvailable(uint8_t chan, uint16_t num) {
+    if (!CHAN_OK(chan) || !uart_initialized[chan]) {
+        // Bad channel or not initialized
+        OS_Abort(UART_ERROR);
+        return FALSE;
     }
+
+    return (uint8_t)(_RXHn[chan] - _RXTn[chan]) >= num;
 }
 
 void UART_Flush(uint8_t chan) {
@@ -164,13 +347,8 @@ void UART_Flush(uint8_t chan) {
         return;
     }
 
-    uint16_t old_sreg = SREG;
-    cli();
-
-    _RXRn[chan] = _RXIn[chan];
-    _RXWn[chan] = FALSE;
-
-    SREG = old_sreg;
+    // Everything received so far has been read
+    _RXTn[chan] = _RXHn[chan];
 }
 
 
@@ -180,8 +358,8 @@ bool UART_Writable(uint8_t chan){
         OS_Abort(UART_ERROR);
         return FALSE;
     }
-    // Transmit buffer empty
-    return ((*UCSRnA[chan]) & _BV(UDREn[chan]));
+    // Everything queued has gone to the transmitter
+    return _TXHn[chan] == _TXTn[chan];
 }
 
 
@@ -192,9 +370,6 @@ void UART_print(uint8_t chan, const char* fmt, ...) {
         return;
     }
 
-    uint16_t old_sreg = SREG;
-    cli();
-
     uint8_t buffer[TX_BUFFER_SIZE];
     size_t size;
     va_list args;
@@ -203,9 +378,12 @@ void UART_print(uint8_t chan, const char* fmt, ...) {
     size = vsnprintf((char*)buffer, TX_BUFFER_SIZE, fmt, args);
     va_end(args);
 
-    UART_send_raw_bytes(chan, size, buffer);
+    // vsnprintf() returns the length it wanted, not what fit
+    if (size >= TX_BUFFER_SIZE) {
+        size = TX_BUFFER_SIZE - 1;
+    }
 
-    SREG = old_sreg;
+    UART_send_raw_bytes(chan, size, buffer);
 }
 
 
@@ -229,12 +407,9 @@ void UART_ISR(uint8_t chan) {
         return;
     }
 
-    // Busy wait for data to be received, should
-    // be instant, since the ISR ran
-    while ( !((*UCSRnA[chan]) & _BV(RXCn[chan])))
-        ;
+    uint8_t head = _RXHn[chan];
 
-    if (_RXWn[chan] && _RXRn[chan] == _RXIn[chan]){
+    if ((uint8_t)(head - _RXTn[chan]) == _RXSIZEn[chan]) {
         // Ring buffer is full
         LOG("UART RX[%u] full: Dropping data!\n", chan);
         uint8_t dummy;
@@ -243,19 +418,15 @@ void UART_ISR(uint8_t chan) {
 
     } else {
         // Write the rx data into the ring buffer
-        _RXBUFn[chan][_RXIn[chan]] = *UDRn[chan];
-
-        // Update the ring buffer index
-        _RXIn[chan] = (_RXIn[chan] + 1) % RX_BUFFER_SIZE;
-
-        // Check for index wrap / overflow
-        if (_RXIn[chan] == 0) {
-            if (_RXWn[chan]) {
-                LOG("!! Wrapped again?!\n");
-                OS_Abort(UART_ERROR);
-            } else {
-                _RXWn[chan] = TRUE;
-            }
+        uint8_t byte = *UDRn[chan];
+        _RXBUFn[chan][head & (_RXSIZEn[chan] - 1)] = byte;
+        _RXHn[chan] = head + 1;
+
+        // Wake the waiting task once it has what it asked for, last in the handler
+        uint8_t want = _RXWANTn[chan];
+        if (want != 0 && ((uint8_t)(head + 1 - _RXTn[chan]) >= want || byte == _RXDELIMn[chan])) {
+            _RXWANTn[chan] = 0;
+            Msg_ASend_ISR(_RXPIDn[chan], _RXTYPEn[chan], head + 1 - _RXTn[chan]);
         }
     }
 }
@@ -275,3 +446,19 @@ ISR(USART2_RX_vect) {
 ISR(USART3_RX_vect) {
     UART_ISR(3);
 }
+
+ISR(USART0_UDRE_vect) {
+    UART_Send_Next(0);
+}
+
+ISR(USART1_UDRE_vect) {
+    UART_Send_Next(1);
+}
+
+ISR(USART2_UDRE_vect) {
+    UART_Send_Next(2);
+}
+
+ISR(USART3_UDRE_vect) {
+    UART_Send_Next(3);
+}
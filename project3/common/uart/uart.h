@@ -4,17 +4,48 @@
 #include <avr/common.h>
 
 #define TX_BUFFER_SIZE 64
-#define RX_BUFFER_SIZE 32
+#define TX_RING_SIZE   64   /* Bytes queued per channel for the UDRE interrupt, a power of 2 */
+#define RX_BUFFER_SIZE 32   /* Bytes received per channel, unless RX_SIZE_n says otherwise */
+
+/* Each channel's RX ring is a power of 2, up to 128 bytes */
+#ifndef RX_SIZE_0
+#define RX_SIZE_0 RX_BUFFER_SIZE
+#endif
+#ifndef RX_SIZE_1
+#define RX_SIZE_1 RX_BUFFER_SIZE
+#endif
+#ifndef RX_SIZE_2
+#define RX_SIZE_2 RX_BUFFER_SIZE
+#endif
+#ifndef RX_SIZE_3
+#define RX_SIZE_3 RX_BUFFER_SIZE
+#endif
 
 #define MYBRR(baud_rate) (F_CPU / 16 / (baud_rate) - 1)
 
 void UART_Init(uint8_t chan, uint32_t baud_rate);
 void UART_Transmit(uint8_t chan, uint8_t byte);
+bool UART_Queue(uint8_t chan, uint8_t byte);
+bool UART_Transmit_Timeout(uint8_t chan, uint8_t byte, uint16_t timeout);
 bool UART_Async_Receive(uint8_t chan, uint8_t* out);
 
 bool UART_Available(uint8_t chan);
 bool UART_BytesAvailable(uint8_t chan, uint16_t num);
 void UART_Flush(uint8_t chan);
+uint8_t UART_Read(uint8_t chan, uint8_t* buf, uint8_t n);
+uint8_t UART_Peek(uint8_t chan, uint8_t* buf, uint8_t n);
+
+#define UART_NO_DELIM (-1)
+
+/*
+ Blocks the calling task until `count` bytes are waiting on `chan`, or the byte
+ `delim` has arrived (UART_NO_DELIM for none), or `timeout` TICKs pass (0 waits
+ forever). A `count` of 0 waits for the ring to fill. Returns the number of bytes waiting.
+ The RX interrupt wakes the task with Msg_ASend_ISR() of message type `type`, so
+ the task must be created with Task_Create_Mailbox(), or a wakeup can be missed.
+ Only one task may wait on a channel.
+*/
+uint8_t UART_Wait(uint8_t chan, uint8_t count, int16_t delim, uint8_t type, uint16_t timeout);
 
 bool UART_Writable(uint8_t chan);
 
@@ -1,10 +1,12 @@
 #include <avr/io.h>
+#include <util/atomic.h>
 #include <util/delay.h>
 #include "Roomba.h"
 #include "Arm.h"
 #include "Joystick.h"
 #include "Motor.h"
 #include "Packet.h"
+#include "schedule.h"
 
 extern "C" {
     #include "kernel.h"
@@ -29,8 +31,27 @@ extern "C" {
 #define STUPID 0
 
 Roomba roomba(/*Serial*/ 3, /*Port A pin*/ 0);
+/**
+ * The last good packet. RXData replaces it from a SYSTEM task that the RX interrupt
+ * wakes, so it can preempt any reader part way through. It is only written with
+ * setPacket() and read through a copy from getPacket(), both with interrupts off.
+ */
 Packet packet(512, 512, 0, 512, 512, 0);
 
+void setPacket(const Packet& p) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        packet = p;
+    }
+}
+
+Packet getPacket() {
+    Packet p;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        p = packet;
+    }
+    return p;
+}
+
 Arm arm;
 
 // 30 seconds === 30000 ms
@@ -42,6 +63,7 @@ volatile bool dead = false;
 volatile uint16_t light_average = 0;
 volatile bool started_before = false;
 volatile int16_t continue_move = -1;
+volatile bool mode_changed = false;
 
 void choose_move(Move* move) {
     bool is_wall = roomba.check_virtual_wall();
@@ -84,7 +106,8 @@ void choose_move(Move* move) {
         return;
     }
 
-    choose_user_move(move, 1023 - packet.joy1X(), 1023 - packet.joy1Y(), mode);
+    Packet current = getPacket();
+    choose_user_move(move, 1023 - current.joy1X(), 1023 - current.joy1Y(), mode);
 
     if (move->left_speed == 0 && move->right_speed == 0 && mode == STAY_MODE && STUPID) {
         forward(move, 8);
@@ -102,8 +125,9 @@ void UpdateArm(void) {
     arm.attach(2, 3);
 
     TASK({
-        arm.setSpeedX(Arm::filterSpeed(packet.joy2X()));
-        arm.setSpeedY(Arm::filterSpeed(packet.joy2Y()));
+        Packet current = getPacket();
+        arm.setSpeedX(Arm::filterSpeed(current.joy2X()));
+        arm.setSpeedY(Arm::filterSpeed(current.joy2Y()));
     })
 }
 
@@ -123,7 +147,7 @@ void laserStrength(void) {
 void TickArm(void) {
     TASK({
         arm.tick();
-        if (packet.joy1SW() && numLaserTicks > 0) {
+        if (getPacket().joy1SW() && numLaserTicks > 0) {
             BIT_SET(PORTC, 0);
             if (game_on) {
                 numLaserTicks -= ARM_TICK_PERIOD;
@@ -150,8 +174,8 @@ void modeChange(void) TASK ({
         ? STAY_MODE
         : FREE_MODE;
 
-    // Play the same song
-    roomba.play_song(STAY_SONG);
+    // commandRoomba() plays the same song, only it talks to the Roomba
+    mode_changed = true;
 
     // uint8_t song = (mode == FREE_MODE)
     //     ? FREE_SONG
@@ -204,16 +228,36 @@ void die(void) {
     }
     dead = true;
     LOG("DEAD\n");
-    roomba.leds(0, 255, 255);
-    roomba.play_song(DEAD_SONG);
+    // commandRoomba() shows it, only it talks to the Roomba
     // Task_Create_RR(deadSong, 0);
 }
 
+/**
+ * A RR task that drives the Roomba every COMMAND_ROOMBA_PERIOD TICKs. Reading the
+ * sensors sleeps while the Roomba answers, which a Periodic task can't do.
+ */
 void commandRoomba() {
     Move move;
+    bool shown_dead = false;
+    TICK next = Now() + COMMAND_ROOMBA_DELAY;
+
     for (;;) {
+        Task_SleepUntil(next);
+        next += COMMAND_ROOMBA_PERIOD;
+
+        if (dead && !shown_dead) {
+            roomba.leds(0, 255, 255);
+            roomba.play_song(DEAD_SONG);
+        }
+        shown_dead = dead;
+
+        if (mode_changed) {
+            mode_changed = false;
+            roomba.play_song(STAY_SONG);
+        }
+
         // Check if we should start the game
-        if (packet.joy2SW() && (!game_on || dead)) {
+        if (getPacket().joy2SW() && (!game_on || dead)) {
             start_game();
         }
 
@@ -224,8 +268,6 @@ void commandRoomba() {
         int16_t right_speed = roomba_speed(move.right_speed);
 
         roomba.direct_drive(left_speed, right_speed);
-
-        Task_Next();
     }
 }
 
@@ -236,91 +278,114 @@ void setupRoomba() {
     load_songs();
     roomba.play_song(FREE_SONG);
 
-    Task_Create_Period(commandRoomba, 0, COMMAND_ROOMBA_PERIOD, COMMAND_ROOMBA_WCET, COMMAND_ROOMBA_DELAY);
+    Task_Create_RR(commandRoomba, 0);
 }
 
 
+FRAME_PARSER rx_parser;
+
 /**
- * A Periodic task to receive packets from a sender.
+ * Feeds everything received to the frame parser, and keeps the last good packet
  */
-void RXData(void) {
-    uint8_t data_channel = 2;
+void RXFrames(uint8_t data_channel) {
+    uint8_t bytes[16];
+    uint8_t i, n;
+    Packet rx_packet;
+
+    while ((n = UART_Read(data_channel, bytes, sizeof(bytes))) > 0) {
+        for (i = 0; i < n; i += 1) {
+            if (Frame_Feed(&rx_parser, bytes[i]) == FRAME_GOOD) {
+                // The checksum is good, the magic says it is a packet
+                rx_packet = Packet(rx_parser.payload);
+                if (rx_packet.magic() == PACKET_MAGIC) {
+                    setPacket(rx_packet);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Finds a packet by its magic, in unframed data
+ */
+void RXMagic(uint8_t data_channel) {
     uint8_t buffer[PACKET_SIZE];
-    uint8_t byte, i;
     bool magic_ok, checksum_ok;
-    Packet rx_packet = packet;
+    Packet rx_packet;
+
+    // Drop bytes until a packet's magic is at the front
+    while (UART_Peek(data_channel, buffer, PACKET_MAGIC_SIZE) == PACKET_MAGIC_SIZE &&
+           TO16BIT(buffer[0], buffer[1]) != PACKET_MAGIC) {
+        UART_Read(data_channel, buffer, 1);
+    }
+
+    // After dropping bytes the rest of the packet may still be arriving
+    if (UART_BytesAvailable(data_channel, PACKET_SIZE)) {
+        UART_Read(data_channel, buffer, PACKET_SIZE);
+
+        // Store buffer as packet, automatically
+        // calculates the checksum on it's own
+        rx_packet = Packet(buffer);
+
+        magic_ok = (rx_packet.magic() == PACKET_MAGIC &&
+                    rx_packet.magic() == TO16BIT(
+                        buffer[0],
+                        buffer[1]
+                    )
+        );
+
+        checksum_ok = rx_packet.checksum() == TO16BIT(
+            buffer[PACKET_SIZE - 2],
+            buffer[PACKET_SIZE - 1]
+        );
+
+        // Sanity check, magic and checksum match what came in
+        if (magic_ok && checksum_ok) {
+            setPacket(rx_packet);
+        }
+    }
+}
+
+/**
+ * A SYSTEM task to receive packets from a sender. The UART's RX interrupt wakes
+ * it as soon as a frame's delimiter, or a whole unframed packet, is waiting,
+ * instead of it polling every period.
+ * PORTB 0 is high while it handles a packet, for timing against the base's PORTB 0.
+ */
+static const MTYPE RX_WAKE = 0x01;
+ASYNC_MSG rx_mailbox[1];
+
+void RXData(void) {
+    uint8_t data_channel = 2;
     UART_Init(data_channel, 38400);
+    Frame_Init(&rx_parser, PACKET_SIZE);
 
-    TASK({
-        BIT_SET(PORTB, 0);
-        if (UART_Available(data_channel)) {
-            // Available byte is the high byte of packet magic
-            if (UART_Async_Receive(data_channel, &byte) && byte == HIGH_BYTE(PACKET_MAGIC)) {
-                buffer[0] = byte;
-
-                // Next available byte is low byte of packet magic
-                if (UART_Async_Receive(data_channel, &byte) && byte == LOW_BYTE(PACKET_MAGIC)) {
-                    buffer[1] = byte;
-
-                    // Rest of packet is available
-                    if (UART_BytesAvailable(data_channel, PACKET_SIZE - PACKET_MAGIC_SIZE)) {
-
-                        // Read in rest of packet
-                        for (i = 2; i < PACKET_SIZE; i += 1) {
-                            if (UART_Async_Receive(data_channel, &byte)){
-                                buffer[i] = byte;
-                            } else {
-                                LOG("Expected a packet to be available!\n");
-                                buffer[i] = 0;
-                            }
-                        }
-
-                        // Store buffer as packet, automatically
-                        // calculates the checksum on it's own
-                        rx_packet = Packet(buffer);
-
-                        magic_ok = (rx_packet.magic() == PACKET_MAGIC &&
-                                    rx_packet.magic() == TO16BIT(
-                                        buffer[0],
-                                        buffer[1]
-                                    )
-                        );
-
-                        checksum_ok = rx_packet.checksum() == TO16BIT(
-                            buffer[PACKET_SIZE - 2],
-                            buffer[PACKET_SIZE - 1]
-                        );
-
-                        // Sanity check, magic and checksum match what came in
-                        if (magic_ok && checksum_ok) {
-                            packet = Packet(buffer);
-                        }
-
-                        BIT_CLR(PORTB, 0);
-                        // Hacky continue, fall through for everything else
-                        // causes UART to flush the RX buffer. We don't actually
-                        // want to flush if we just got a packet
-                        continue;
-                    } /* Packet remainder available */
-                } /* Rx low byte */
-            } /* Rx high byte */
-
-            UART_Flush(data_channel);
-
-        } /* Rx available */
+    for (;;) {
+        if (PACKET_COBS) {
+            UART_Wait(data_channel, 0, FRAME_DELIM, RX_WAKE, 0);
+            BIT_SET(PORTB, 0);
+            RXFrames(data_channel);
+        } else {
+            UART_Wait(data_channel, PACKET_SIZE, UART_NO_DELIM, RX_WAKE, 0);
+            BIT_SET(PORTB, 0);
+            RXMagic(data_channel);
+        }
 
         BIT_CLR(PORTB, 0);
-    })
+    }
 }
 
 void logPacket(void) TASK({
     BIT_SET(PORTB, 1);
+    Packet packet = getPacket();
     LOG(">> [%X]:[%u]:[%u]:[%u]:[%u]:[%c]:[%c]:{0x%X}\n", packet.magic(),
         packet.joy1X(), packet.joy1Y(),
         packet.joy2X(), packet.joy2Y(),
         packet.joy1SW() ? '#' : '/',
         packet.joy2SW() ? '#' : '/',
         packet.checksum());
+    LOG(">> frames good %u, framing errors %u, checksum errors %u\n",
+        rx_parser.good, rx_parser.framing_errors, rx_parser.checksum_errors);
     BIT_CLR(PORTB, 1);
 })
 
@@ -347,6 +412,22 @@ void lightSensorRead(void) {
     }
 }
 
+constexpr PeriodicTask periodic_tasks[] = {
+    { UpdateArm,       0, UPDATE_ARM_PERIOD,   UPDATE_ARM_WCET,   UPDATE_ARM_DELAY   },
+    { TickArm,         0, ARM_TICK_PERIOD,     ARM_TICK_WCET,     ARM_TICK_DELAY     },
+    { lightSensorRead, 0, LIGHT_SENSOR_PERIOD, LIGHT_SENSOR_WCET, LIGHT_SENSOR_DELAY }
+};
+
+static_assert(schedule::valid(periodic_tasks), "Remote station has an invalid periodic task in timings.h");
+
+// conflict_free() does not hold for these rates. UpdateArm and TickArm are released
+// together on every odd TICK, and lightSensorRead's 2 TICK window overlaps both of
+// them. modeChange starts with the game, at no particular TICK, so it isn't in the set.
+// Under POLICY_RELEASE it runs only while each job finishes before the next release,
+// which nothing checks at compile time. There is no schedule table for it, a POLICY=TABLE
+// build stops here.
+static_assert(PERIODIC_POLICY != POLICY_TABLE, "Remote station periodic tasks overlap, no schedule table for timings.h");
+
 /**
  *
  */
@@ -369,11 +450,10 @@ void create(void)
     BIT_CLR(DDRA, 3);
     BIT_SET(PORTA, 3);
 
-    Task_Create_Period(UpdateArm, 0, UPDATE_ARM_PERIOD, UPDATE_ARM_WCET, UPDATE_ARM_DELAY);
-    Task_Create_Period(TickArm, 0, ARM_TICK_PERIOD, ARM_TICK_WCET, ARM_TICK_DELAY);
-    Task_Create_Period(RXData, 0, GET_DATA_PERIOD, GET_DATA_WCET, GET_DATA_DELAY);
-    Task_Create_Period(lightSensorRead, 0, LIGHT_SENSOR_PERIOD, LIGHT_SENSOR_WCET, LIGHT_SENSOR_DELAY);
-    Task_Create_RR(setupRoomba, 0);
+    schedule::create(periodic_tasks);
+    Task_Create_Mailbox(RXData, 0, SYSTEM, rx_mailbox, 1, 0);
+    // Setting up the Roomba goes through its UART and songs, give it room
+    Task_Create_Stack(setupRoomba, 0, RR, 2 * WORKSPACE);
 
     // Task_Create_Period(logPacket, 0, 10, 5, 15);
 